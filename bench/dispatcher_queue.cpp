@@ -0,0 +1,168 @@
+//
+// Created by kier on 2020/12/2.
+//
+
+#include "ohm/thread/dispatcher_queue.h"
+#include "ohm/print.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+/**
+ * Push `items` values from `producers` threads into a queue consumed by `consumers` threads.
+ * @return million items per second
+ */
+double contention(ohm::DispatcherStorage storage, int producers, int consumers, int64_t items, int64_t limit,
+                  size_t batch = 1) {
+    ohm::DispatcherQueue<int64_t> queue(limit);
+    queue.storage(storage);
+    queue.batch(batch);
+
+    std::atomic<int64_t> consumed(0);
+    std::atomic<int64_t> checksum(0);
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+
+    for (int i = 0; i < consumers; ++i) {
+        queue.bind([&](int64_t value) {
+            checksum += value;
+            if (++consumed == items) {
+                std::unique_lock<std::mutex> _lock(done_mutex);
+                done_cond.notify_all();
+            }
+        });
+    }
+
+    auto beg = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    auto each = items / producers;
+    for (int i = 0; i < producers; ++i) {
+        auto first = each * i;
+        auto last = i + 1 == producers ? items : first + each;
+        threads.emplace_back([&queue, first, last, batch]() {
+            if (batch <= 1) {
+                for (auto v = first; v < last; ++v) queue.push(v);
+                return;
+            }
+            std::vector<int64_t> values;
+            for (auto v = first; v < last; v += int64_t(batch)) {
+                values.clear();
+                for (auto k = v; k < last && k < v + int64_t(batch); ++k) values.push_back(k);
+                queue.push_bulk(values.begin(), values.end());
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    {
+        std::unique_lock<std::mutex> _lock(done_mutex);
+        while (consumed.load() < items) done_cond.wait_for(_lock, std::chrono::milliseconds(10));
+    }
+    auto end = std::chrono::steady_clock::now();
+    queue.clear();
+
+    if (checksum.load() != items * (items - 1) / 2) {
+        ohm::println("[ERROR] checksum mismatch on ", storage, " ", producers, "x", consumers);
+    }
+
+    auto seconds = std::chrono::duration<double>(end - beg).count();
+    return double(items) / seconds / 1e6;
+}
+
+/**
+ * Push timestamps one by one with `gap` between, so consumer is idle when each value comes.
+ * @return wakeup latencies in microseconds, sorted
+ */
+std::vector<double> latency(ohm::DispatcherStorage storage, ohm::DispatcherWait policy, int64_t items,
+                            std::chrono::microseconds gap) {
+    using clock = std::chrono::steady_clock;
+    ohm::DispatcherQueue<clock::time_point> queue(1024);
+    queue.storage(storage);
+    queue.waiting(policy);
+
+    std::vector<double> latencies;
+    latencies.reserve(size_t(items));
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+
+    queue.bind([&](clock::time_point stamp) {
+        auto end = clock::now();
+        std::unique_lock<std::mutex> _lock(done_mutex);
+        latencies.push_back(std::chrono::duration<double, std::micro>(end - stamp).count());
+        done_cond.notify_all();
+    });
+
+    for (int64_t i = 0; i < items; ++i) {
+        queue.push(clock::now());
+        std::this_thread::sleep_for(gap);
+    }
+    {
+        std::unique_lock<std::mutex> _lock(done_mutex);
+        while (int64_t(latencies.size()) < items) done_cond.wait_for(_lock, std::chrono::milliseconds(10));
+    }
+    queue.clear();
+
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    auto index = size_t(p * double(sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char *argv[]) {
+    int64_t items = argc > 1 ? std::atoll(argv[1]) : 1000000;
+    int64_t limit = argc > 2 ? std::atoll(argv[2]) : 1024;
+
+    ohm::println("items = ", items, ", limit = ", limit, ", values in M items/s");
+    ohm::println("P x C  \tdeque\tmpmc\tspsc");
+    int threads[] = {1, 2, 4, 8};
+    for (auto producers : threads) {
+        for (auto consumers : threads) {
+            auto deque = contention(ohm::DISPATCH_STORAGE_DEQUE, producers, consumers, items, limit);
+            auto mpmc = contention(ohm::DISPATCH_STORAGE_MPMC, producers, consumers, items, limit);
+            if (producers == 1 && consumers == 1) {
+                auto spsc = contention(ohm::DISPATCH_STORAGE_SPSC, producers, consumers, items, limit);
+                ohm::println(producers, " x ", consumers, "\t", deque, "\t", mpmc, "\t", spsc);
+            } else {
+                ohm::println(producers, " x ", consumers, "\t", deque, "\t", mpmc, "\t-");
+            }
+        }
+    }
+
+    ohm::println();
+    ohm::println("batch (push_bulk + worker batch), 4 x 4\tdeque\tmpmc");
+    size_t batches[] = {1, 4, 16, 64};
+    for (auto batch : batches) {
+        auto deque = contention(ohm::DISPATCH_STORAGE_DEQUE, 4, 4, items, limit, batch);
+        auto mpmc = contention(ohm::DISPATCH_STORAGE_MPMC, 4, 4, items, limit, batch);
+        ohm::println(batch, "\t", deque, "\t", mpmc);
+    }
+
+    ohm::println();
+    // spinning policies need a free core for each waiting thread
+    ohm::println("wakeup latency in us, 1 x 1, one value every 50us, ",
+                 std::thread::hardware_concurrency(), " hardware threads");
+    ohm::println("storage\tpolicy\tp50\tp90\tp99\tp99.9");
+    std::pair<ohm::DispatcherStorage, const char *> storages[] = {
+            {ohm::DISPATCH_STORAGE_DEQUE, "deque"},
+            {ohm::DISPATCH_STORAGE_SPSC, "spsc"},
+    };
+    std::pair<ohm::DispatcherWait, const char *> policies[] = {
+            {ohm::DISPATCH_WAIT_BLOCK, "block"},
+            {ohm::DISPATCH_WAIT_SPIN, "spin"},
+            {ohm::DISPATCH_WAIT_POLL, "poll"},
+    };
+    auto samples = std::min<int64_t>(items / 50, 20000);
+    for (auto &storage : storages) {
+        for (auto &policy : policies) {
+            auto sorted = latency(storage.first, policy.first, samples, std::chrono::microseconds(50));
+            ohm::println(storage.second, "\t", policy.second, "\t",
+                         percentile(sorted, 0.5), "\t", percentile(sorted, 0.9), "\t",
+                         percentile(sorted, 0.99), "\t", percentile(sorted, 0.999));
+        }
+    }
+
+    return 0;
+}
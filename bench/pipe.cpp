@@ -0,0 +1,358 @@
+//
+// Created by kier on 2020/12/18.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/random.h"
+#include "ohm/print.h"
+
+#include <list>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
+
+/**
+ * Pipe scheduling benchmark on synthetic graphs.
+ * Usage:
+ * ```
+ * bench_pipe                                    # default sweep
+ * bench_pipe stages=4 threads=2 service=exp:50 out=pipe.csv
+ * ```
+ * Options, `key=value`:
+ *   stages     number of map stages, the sealed stage not counted, default 4
+ *   threads    N of each map stage, default 1
+ *   limit      queue limit of each pipe, default 64
+ *   mode       wait, new, old: what full queue keeps, default wait
+ *   storage    deque, mpmc: queue storage, default deque
+ *   waiting    block, spin, poll: how idle workers wait, default block
+ *   executor   1 to run all stages on shared work-stealing pool, default 0
+ *   fuse       1 to fuse adjacent 1:1 stages, default 0
+ *   profile    1 to profile each pipe, default 0
+ *   sampling   timing and tracing sampling of profiled pipes: every, <n> for one in n, rate:<per second>
+ *   payload    bytes of payload of each item, distribution like service, default 0
+ *   service    service time of each stage in us, distribution, default none
+ *   items      items of throughput run, default 20000
+ *   probes     items of per-hop overhead run, pushed one after another finished, default 2000
+ *   seed       seed of service time and payload size, default 4481
+ *   out        CSV file results appended to, one line each run, default none
+ * Distributions: <value>, none, const:<value>, exp:<mean>, normal:<mean>:<sd>, uniform:<min>:<max>.
+ */
+
+using clock_type = std::chrono::steady_clock;
+
+struct Config {
+    int stages = 4;
+    int threads = 1;
+    int64_t limit = 64;
+    std::string mode = "wait";
+    std::string storage = "deque";
+    std::string waiting = "block";
+    bool executor = false;
+    bool fuse = false;
+    bool profile = false;
+    std::string sampling = "every";
+    std::string payload = "0";
+    std::string service = "none";
+    int64_t items = 20000;
+    int64_t probes = 2000;
+    int seed = 4481;
+};
+
+struct Result {
+    int64_t delivered = 0;
+    double seconds = 0;
+    std::vector<double> latencies;      ///< end-to-end latency of each delivered item in us, sorted
+    double service = 0;                 ///< sum of service time of delivered items in us
+};
+
+struct Item {
+    int64_t id;
+    clock_type::time_point stamp;
+    std::vector<float> service;         ///< service time of each stage in us
+    std::vector<uint8_t> payload;
+};
+
+/**
+ * Random value drawn from distribution given by spec, like service time or payload size.
+ */
+class Distribution {
+public:
+    Distribution(const std::string &spec, int seed)
+            : m_random(seed) {
+        std::vector<std::string> fields;
+        std::istringstream iss(spec);
+        std::string field;
+        while (std::getline(iss, field, ':')) fields.push_back(field);
+        if (fields.empty()) fields.push_back("none");
+        // plain number is constant
+        if (fields.size() == 1 && !fields[0].empty() && (std::isdigit(fields[0][0]) || fields[0][0] == '.')) {
+            fields.insert(fields.begin(), "const");
+        }
+        m_kind = fields[0];
+        if (fields.size() > 1) m_a = std::atof(fields[1].c_str());
+        if (fields.size() > 2) m_b = std::atof(fields[2].c_str());
+        if (m_kind != "none" && m_kind != "const" && m_kind != "exp" &&
+            m_kind != "normal" && m_kind != "uniform") {
+            throw ohm::Exception("Unknown distribution: " + spec);
+        }
+    }
+
+    /**
+     * @return non-negative value
+     */
+    double next() {
+        double value = 0;
+        if (m_kind == "const") value = m_a;
+        else if (m_kind == "exp") value = m_random.exp(m_a);
+        else if (m_kind == "normal") value = m_random.normal(m_a, m_b);
+        else if (m_kind == "uniform") value = m_a + (m_b - m_a) * m_random.u();
+        return std::max(value, 0.0);
+    }
+
+private:
+    ohm::Random m_random;
+    std::string m_kind;
+    double m_a = 0;     ///< mean, or min of uniform
+    double m_b = 0;     ///< standard deviation, or max of uniform
+};
+
+/**
+ * Keep CPU busy for `us`, sleeping is too coarse for microsecond services.
+ */
+void spin(float us) {
+    if (us <= 0) return;
+    auto end = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(
+            std::chrono::duration<float, std::micro>(us));
+    while (clock_type::now() < end);
+}
+
+ohm::DispatcherSampling sampling(const std::string &spec) {
+    if (spec.compare(0, 5, "rate:") == 0) return ohm::DispatcherSampling::PerSecond(std::atof(spec.c_str() + 5));
+    if (spec == "every") return ohm::DispatcherSampling::Every();
+    return ohm::DispatcherSampling::OneIn(std::atoll(spec.c_str()));
+}
+
+void setup(ohm::Pipe<Item> &pipe, const Config &config, int index) {
+    pipe.limit(config.limit);
+    if (config.profile) pipe.profile("stage" + std::to_string(index), sampling(config.sampling));
+    if (config.storage == "mpmc") pipe.storage(ohm::DISPATCH_STORAGE_MPMC, size_t(config.limit));
+    if (config.waiting == "spin") pipe.waiting(ohm::DISPATCH_WAIT_SPIN);
+    else if (config.waiting == "poll") pipe.waiting(ohm::DISPATCH_WAIT_POLL);
+    if (config.mode == "new") pipe.keep_new();
+    else if (config.mode == "old") pipe.keep_old();
+}
+
+/**
+ * Build graph of `config`, push `items`, wait all delivered.
+ * @param probe push one item after the last one delivered, to measure overhead without queuing.
+ */
+Result run(const Config &config, int64_t items, bool probe) {
+    Distribution service(config.service, config.seed);
+    Distribution payload(config.payload, config.seed + 1);
+
+    Result result;
+    std::vector<double> latencies(size_t(items), -1);
+    std::vector<double> services(size_t(items), 0);
+    std::atomic<int64_t> delivered(0);
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+
+    // mapped pipes keep pointer of parent, so keep them in list
+    std::list<ohm::Pipe<Item>> pipes(1);
+    auto &root = pipes.front();
+    if (config.executor) root.executor();
+    if (config.fuse) root.fuse();
+    setup(root, config, 0);
+    for (int i = 0; i < config.stages; ++i) {
+        pipes.push_back(pipes.back().map(size_t(config.threads), [i](Item item) {
+            spin(item.service[i]);
+            return item;
+        }));
+        setup(pipes.back(), config, i + 1);
+    }
+    pipes.back().seal(1, [&](Item item) {
+        auto latency = std::chrono::duration<double, std::micro>(clock_type::now() - item.stamp).count();
+        latencies[size_t(item.id)] = latency;
+        double sum = 0;
+        for (auto us : item.service) sum += us;
+        services[size_t(item.id)] = sum;
+        ++delivered;
+        if (probe) {
+            std::unique_lock<std::mutex> _lock(done_mutex);
+            done_cond.notify_all();
+        }
+    });
+
+    // draw all random values before timing, payloads are allocated when pushing like real sources
+    auto count = size_t(items);
+    std::vector<Item> inputs(count);
+    std::vector<size_t> payloads(count);
+    for (int64_t i = 0; i < items; ++i) {
+        auto &item = inputs[size_t(i)];
+        item.id = i;
+        item.service.resize(size_t(config.stages));
+        for (auto &us : item.service) us = float(service.next());
+        payloads[size_t(i)] = size_t(payload.next());
+    }
+
+    auto beg = clock_type::now();
+    for (auto &item : inputs) {
+        auto id = item.id;
+        item.payload.resize(payloads[size_t(id)]);
+        item.stamp = clock_type::now();
+        root.push(std::move(item));
+        if (probe) {
+            std::unique_lock<std::mutex> _lock(done_mutex);
+            while (delivered.load() <= id) done_cond.wait_for(_lock, std::chrono::milliseconds(10));
+        }
+    }
+    root.close();
+    root.completion().wait();
+    auto end = clock_type::now();
+
+    result.seconds = std::chrono::duration<double>(end - beg).count();
+    result.delivered = delivered.load();
+    for (size_t i = 0; i < latencies.size(); ++i) {
+        if (latencies[i] < 0) continue;
+        result.latencies.push_back(latencies[i]);
+        result.service += services[i];
+    }
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    auto index = size_t(p * double(sorted.size() - 1));
+    return sorted[index];
+}
+
+std::string describe(const Config &config) {
+    std::ostringstream oss;
+    oss << config.stages << "," << config.threads << "," << config.limit << ","
+        << config.mode << "," << config.storage << "," << config.waiting << ","
+        << config.executor << "," << config.fuse << "," << config.profile << "," << config.sampling << "," << config.payload << "," << config.service;
+    return oss.str();
+}
+
+static const char *CSV_HEADER = "stages,threads,limit,mode,storage,waiting,executor,fuse,profile,sampling,payload,service,"
+                                "items,delivered,seconds,items_per_s,hop_us,p50_us,p90_us,p99_us,max_us";
+
+/**
+ * Run throughput and per-hop overhead of `config`, print and append results to `out`.
+ */
+void bench(const Config &config, std::ofstream &out) {
+    auto load = run(config, config.items, false);
+    auto probe = run(config, config.probes, true);
+
+    // with one item in graph at a time, latency minus service time is spent passing queues
+    auto hops = config.stages + 1;
+    double overhead = 0;
+    if (!probe.latencies.empty()) {
+        double sum = 0;
+        for (auto latency : probe.latencies) sum += latency;
+        overhead = (sum - probe.service) / double(probe.latencies.size()) / hops;
+    }
+
+    auto throughput = load.seconds > 0 ? double(load.delivered) / load.seconds : 0;
+    std::ostringstream line;
+    line << describe(config) << "," << config.items << "," << load.delivered << "," << load.seconds << ","
+         << throughput << "," << overhead << "," << percentile(load.latencies, 0.5) << ","
+         << percentile(load.latencies, 0.9) << "," << percentile(load.latencies, 0.99) << ","
+         << (load.latencies.empty() ? 0 : load.latencies.back());
+    ohm::println(line.str());
+    if (out.is_open()) out << line.str() << std::endl;
+}
+
+bool parse(Config &config, std::string &out, const std::string &arg) {
+    auto eq = arg.find('=');
+    if (eq == std::string::npos) return false;
+    auto key = arg.substr(0, eq);
+    auto value = arg.substr(eq + 1);
+    if (key == "stages") config.stages = std::atoi(value.c_str());
+    else if (key == "threads") config.threads = std::atoi(value.c_str());
+    else if (key == "limit") config.limit = std::atoll(value.c_str());
+    else if (key == "mode") config.mode = value;
+    else if (key == "storage") config.storage = value;
+    else if (key == "waiting") config.waiting = value;
+    else if (key == "executor") config.executor = value == "1";
+    else if (key == "fuse") config.fuse = value == "1";
+    else if (key == "profile") config.profile = value == "1";
+    else if (key == "sampling") config.sampling = value;
+    else if (key == "payload") config.payload = value;
+    else if (key == "service") config.service = value;
+    else if (key == "items") config.items = std::atoll(value.c_str());
+    else if (key == "probes") config.probes = std::atoll(value.c_str());
+    else if (key == "seed") config.seed = std::atoi(value.c_str());
+    else if (key == "out") out = value;
+    else return false;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Config config;
+    std::string path;
+    bool sweep = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (!parse(config, path, arg)) {
+            ohm::println("[ERROR] unknown option: ", arg);
+            return 1;
+        }
+        if (arg.compare(0, 4, "out=") != 0 && arg.compare(0, 6, "items=") != 0 &&
+            arg.compare(0, 7, "probes=") != 0 && arg.compare(0, 5, "seed=") != 0) {
+            sweep = false;
+        }
+    }
+
+    std::ofstream out;
+    if (!path.empty()) {
+        bool fresh = !std::ifstream(path).good();
+        out.open(path, std::ios::app);
+        if (!out.is_open()) {
+            ohm::println("[ERROR] can not open ", path);
+            return 1;
+        }
+        if (fresh) out << CSV_HEADER << std::endl;
+    }
+
+    ohm::println(CSV_HEADER);
+    if (!sweep) {
+        bench(config, out);
+        return 0;
+    }
+
+    // default sweep: graph depth and width, scheduling options, then workload shape
+    int stages[] = {1, 4, 8};
+    int threads[] = {1, 4};
+    for (auto s : stages) {
+        for (auto n : threads) {
+            auto each = config;
+            each.stages = s;
+            each.threads = n;
+            bench(each, out);
+        }
+    }
+    const char *options[][2] = {
+            {"storage", "mpmc"},
+            {"waiting", "spin"},
+            {"executor", "1"},
+            {"fuse", "1"},
+            {"profile", "1"},
+            {"mode", "new"},
+            {"payload", "uniform:4096:1048576"},
+            {"service", "const:20"},
+            {"service", "exp:20"},
+            {"service", "normal:20:5"},
+    };
+    for (auto &option : options) {
+        auto each = config;
+        std::string ignored;
+        parse(each, ignored, std::string(option[0]) + "=" + option[1]);
+        bench(each, out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+//
+// Created by kier on 2020/12/20.
+//
+
+#ifndef OMEGA_CLOCK_H
+#define OMEGA_CLOCK_H
+
+#include "platform.h"
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Read time stamp counter in `MonotonicClock` on x86, if it is invariant.
+ * Reading TSC is several times cheaper than `steady_clock` on most systems,
+ *   but calibrated rate may drift from `steady_clock` about 10us each second,
+ *   so it is only suitable for measuring short durations.
+ */
+#ifndef OHM_CLOCK_TSC
+#define OHM_CLOCK_TSC false
+#endif
+
+#if OHM_CLOCK_TSC && OHM_PLATFORM_IS_X86
+#if OHM_PLATFORM_CC_MSVC
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+namespace ohm {
+    /**
+     * Monotonic clock in nanoseconds, never adjusted like `system_clock`, used to measure durations.
+     * Time points are comparable in one process only, use `system_clock` for wall time.
+     */
+    class MonotonicClock {
+    public:
+        using rep = int64_t;
+        using period = std::nano;
+        using duration = std::chrono::nanoseconds;
+        using time_point = std::chrono::time_point<MonotonicClock, duration>;
+
+        static const bool is_steady = true;
+
+        static time_point now() {
+#if OHM_CLOCK_TSC && OHM_PLATFORM_IS_X86
+            auto &tsc = Tsc();
+            if (tsc.scale > 0) {
+                return time_point(duration(tsc.base + int64_t(double(__rdtsc() - tsc.tick) * tsc.scale)));
+            }
+#endif
+            return time_point(std::chrono::duration_cast<duration>(
+                    std::chrono::steady_clock::now().time_since_epoch()));
+        }
+
+        /**
+         * @return if time stamp counter is read, see `OHM_CLOCK_TSC`.
+         */
+        static bool tsc() {
+#if OHM_CLOCK_TSC && OHM_PLATFORM_IS_X86
+            return Tsc().scale > 0;
+#else
+            return false;
+#endif
+        }
+
+    private:
+#if OHM_CLOCK_TSC && OHM_PLATFORM_IS_X86
+        struct Calibration {
+            uint64_t tick = 0;      ///< counter at calibration
+            int64_t base = 0;       ///< steady time at calibration, in nanoseconds
+            double scale = 0;       ///< nanoseconds each tick, 0 if counter not usable
+
+            Calibration() {
+                if (!Invariant()) return;
+                using steady = std::chrono::steady_clock;
+                auto begin_time = steady::now();
+                auto begin_tick = __rdtsc();
+                // calibrate in first call, about 5 milliseconds
+                auto end_time = begin_time;
+                while (end_time - begin_time < std::chrono::milliseconds(5)) end_time = steady::now();
+                auto end_tick = __rdtsc();
+                if (end_tick <= begin_tick) return;
+                auto spent = std::chrono::duration_cast<duration>(end_time - begin_time).count();
+                tick = end_tick;
+                base = std::chrono::duration_cast<duration>(end_time.time_since_epoch()).count();
+                scale = double(spent) / double(end_tick - begin_tick);
+            }
+
+            /**
+             * @return if counter has constant rate and keeps counting in deep sleep states
+             */
+            static bool Invariant() {
+                unsigned int regs[4] = {0};
+#if OHM_PLATFORM_CC_MSVC
+                int info[4];
+                __cpuid(info, 0x80000000);
+                if (unsigned(info[0]) < 0x80000007u) return false;
+                __cpuid(info, 0x80000007);
+                regs[3] = unsigned(info[3]);
+#else
+                if (__get_cpuid_max(0x80000000u, nullptr) < 0x80000007u) return false;
+                __get_cpuid(0x80000007u, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+                return (regs[3] & (1u << 8)) != 0;
+            }
+        };
+
+        static const Calibration &Tsc() {
+            static const Calibration calibration;
+            return calibration;
+        }
+#endif
+    };
+}
+
+#endif //OMEGA_CLOCK_H
@@ -9,6 +9,10 @@
 #include "../type_iterable.h"
 
 #include "pipe_profiler.h"
+#include "pipe_reorder.h"
+#include "pipe_maybe.h"
+#include "pipe_buffer.h"
+#include "pipe_balancer.h"
 
 namespace ohm {
     /**
@@ -122,7 +126,16 @@ namespace ohm {
 
         Pipe(std::shared_ptr<PipeProfiler> profiler)
                 : m_queue(new DispatcherQueue<T>), m_join_links(new std::vector<std::function<void(void)>>),
-                  m_profiler(std::move(profiler)) {}
+                  m_profiler(std::move(profiler)), m_stage(new Stage) {
+            if (m_profiler) {
+                if (m_profiler->executor()) m_queue->executor(m_profiler->executor());
+                if (m_profiler->tracing()) m_queue->trace(true);
+                if (m_profiler->budget()) m_queue->budget(m_profiler->budget());
+                // hold the stage unfinished until queue finished
+                auto stage = m_profiler->completion()->stage();
+                m_queue->on_finished([stage]() {});
+            }
+        }
 
         Pipe()
                 : self(std::make_shared<PipeProfiler>()) {
@@ -138,6 +151,23 @@ namespace ohm {
             m_queue->push(std::move(data));
         }
 
+        /**
+         * Add data to given priority lane, see `lanes`.
+         * @param data
+         * @param lane lane index, 0 is served first
+         */
+        void push(T data, size_t lane) {
+            m_queue->push(std::move(data), lane);
+        }
+
+        /**
+         * Add number of data to pipe with one lock acquisition
+         * @param data
+         */
+        void push_bulk(std::vector<T> data) {
+            m_queue->push_bulk(std::move(data));
+        }
+
         /**
          * got data from pipe, is function could block.
          * @return data from pipe
@@ -161,20 +191,21 @@ namespace ohm {
                 is_pipe_mapper<FUNC, T>::value &&
                 (std::is_copy_constructible<FUNC>::value ||
                  std::is_move_constructible<FUNC>::value)>::type>
-        auto map11(size_t N, FUNC func) -> Pipe<typename is_pipe_mapper<FUNC, T>::mapped_type> {
-            using mapped_type = typename is_pipe_mapper<FUNC, T>::mapped_type;
+        auto map11(size_t N, FUNC func) -> Pipe<typename pipe_unwrap<typename is_pipe_mapper<FUNC, T>::mapped_type>::type> {
+            using mapped_type = typename pipe_unwrap<typename is_pipe_mapper<FUNC, T>::mapped_type>::type;
             Pipe<mapped_type> mapped(m_profiler);
             auto processor = [this, mapped, func](T data) {
                 try {
-                    const_cast<Pipe<mapped_type> &>(mapped).push(func(data));
+                    emit(const_cast<Pipe<mapped_type> &>(mapped), func(std::move(data)));
                 } catch (const PipeLeak &) {}
             };
-            if (N == 0) {
+            if (N == 0 || fusable(N)) {
                 m_queue->bind(processor, true);
             } else {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
             }
-            m_join_links->emplace_back([mapped]() { const_cast<Pipe<mapped_type> &>(mapped).join(); });
+            mapped.m_stage->feeders = N;
+            link(mapped);
             return mapped;
         }
 
@@ -199,10 +230,10 @@ namespace ohm {
             Pipe<mapped_type> mapped(m_profiler);
             auto processor = [this, mapped, func](T data) {
                 try {
-                    auto range = func(data);
+                    auto range = func(std::move(data));
                     auto &pipe = const_cast<Pipe<mapped_type> &>(mapped);
-                    for (auto &out : range) {
-                        pipe.push(out);
+                    for (auto &&out : range) {
+                        pipe.push(std::move(out));
                     }
                 } catch (const PipeLeak &) {}
             };
@@ -211,7 +242,7 @@ namespace ohm {
             } else {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
             }
-            m_join_links->emplace_back([mapped]() { const_cast<Pipe<mapped_type> &>(mapped).join(); });
+            link(mapped);
             return mapped;
         }
 
@@ -231,18 +262,14 @@ namespace ohm {
                  std::is_move_constructible<FUNC>::value) &&
                 is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
         auto map1x(size_t N, FUNC func)
-        -> Pipe<typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type> {
-            using mapped_type = typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type;
+        -> Pipe<typename pipe_unwrap<typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type>::type> {
+            using mapped_type = typename pipe_unwrap<
+                    typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type>::type;
             Pipe<mapped_type> mapped(m_profiler);
             auto processor = [this, mapped, func](T data) {
                 try {
-                    auto generator = func(data);
-                    auto &pipe = const_cast<Pipe<mapped_type> &>(mapped);
-                    try {
-                        while (true) {
-                            pipe.push(generator());
-                        }
-                    } catch (const PipeBreak &) {}
+                    auto generator = func(std::move(data));
+                    drain(generator, const_cast<Pipe<mapped_type> &>(mapped));
                 } catch (const PipeLeak &) {}
             };
             if (N == 0) {
@@ -250,7 +277,7 @@ namespace ohm {
             } else {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
             }
-            m_join_links->emplace_back([mapped]() { const_cast<Pipe<mapped_type> &>(mapped).join(); });
+            link(mapped);
             return mapped;
         }
 
@@ -269,13 +296,13 @@ namespace ohm {
                 is_pipe_mapper_v2<FUNC, T>::value &&
                 (std::is_copy_constructible<FUNC>::value ||
                  std::is_move_constructible<FUNC>::value)>::type>
-        auto map11_v2(size_t N, FUNC func) -> Pipe<typename is_pipe_mapper_v2<FUNC, T>::mapped_type> {
-            using mapped_type = typename is_pipe_mapper_v2<FUNC, T>::mapped_type;
+        auto map11_v2(size_t N, FUNC func) -> Pipe<typename pipe_unwrap<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::type> {
+            using mapped_type = typename pipe_unwrap<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::type;
             Pipe<mapped_type> mapped(m_profiler);
             auto get_processor = [this, mapped, func](int i) {
                 return [this, mapped, func, i](T data) {
                     try {
-                        const_cast<Pipe<mapped_type> &>(mapped).push(func(i, data));
+                        emit(const_cast<Pipe<mapped_type> &>(mapped), func(i, std::move(data)));
                     } catch (const PipeLeak &) {}
                 };
             };
@@ -284,7 +311,7 @@ namespace ohm {
             } else {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(get_processor(int(i)));
             }
-            m_join_links->emplace_back([mapped]() { const_cast<Pipe<mapped_type> &>(mapped).join(); });
+            link(mapped);
             return mapped;
         }
 
@@ -310,10 +337,10 @@ namespace ohm {
             auto get_processor = [this, mapped, func](int i) {
                 return [this, mapped, func, i](T data) {
                     try {
-                        auto range = func(i, data);
+                        auto range = func(i, std::move(data));
                         auto &pipe = const_cast<Pipe<mapped_type> &>(mapped);
-                        for (auto &out : range) {
-                            pipe.push(out);
+                        for (auto &&out : range) {
+                            pipe.push(std::move(out));
                         }
                     } catch (const PipeLeak &) {}
                 };
@@ -323,7 +350,7 @@ namespace ohm {
             } else {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(get_processor(int(i)));
             }
-            m_join_links->emplace_back([mapped]() { const_cast<Pipe<mapped_type> &>(mapped).join(); });
+            link(mapped);
             return mapped;
         }
 
@@ -343,19 +370,15 @@ namespace ohm {
                  std::is_move_constructible<FUNC>::value) &&
                 is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::value>::type>
         auto map1x_v2(size_t N, FUNC func)
-        -> Pipe<typename is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::return_type> {
-            using mapped_type = typename is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::return_type;
+        -> Pipe<typename pipe_unwrap<typename is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::return_type>::type> {
+            using mapped_type = typename pipe_unwrap<
+                    typename is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::return_type>::type;
             Pipe<mapped_type> mapped(m_profiler);
             auto get_processor = [this, mapped, func](int i) {
                 return [this, mapped, func, i](T data) {
                     try {
-                        auto generator = func(i, data);
-                        auto &pipe = const_cast<Pipe<mapped_type> &>(mapped);
-                        try {
-                            while (true) {
-                                pipe.push(generator());
-                            }
-                        } catch (const PipeBreak &) {}
+                        auto generator = func(i, std::move(data));
+                        drain(generator, const_cast<Pipe<mapped_type> &>(mapped));
                     } catch (const PipeLeak &) {}
                 };
             };
@@ -364,7 +387,7 @@ namespace ohm {
             } else {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(get_processor(int(i)));
             }
-            m_join_links->emplace_back([mapped]() { const_cast<Pipe<mapped_type> &>(mapped).join(); });
+            link(mapped);
             return mapped;
         }
 
@@ -394,7 +417,7 @@ namespace ohm {
                 !is_iterable<typename is_pipe_mapper<FUNC, T>::mapped_type>::value &&
                 !is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
         auto map(size_t N, FUNC func, IsMap11= {})
-        -> Pipe<typename is_pipe_mapper<FUNC, T>::mapped_type> {
+        -> Pipe<typename pipe_unwrap<typename is_pipe_mapper<FUNC, T>::mapped_type>::type> {
             return map11(N, func);
         }
 
@@ -434,7 +457,7 @@ namespace ohm {
                  std::is_move_constructible<FUNC>::value) &&
                 is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
         auto map(size_t N, FUNC func, IsMap1x= {})
-        -> Pipe<typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type> {
+        -> Pipe<typename pipe_unwrap<typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type>::type> {
             return map1x(N, func);
         }
 
@@ -455,7 +478,7 @@ namespace ohm {
                 !is_iterable<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::value &&
                 !is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::value>::type>
         auto map(size_t N, FUNC func, IsMap11= {})
-        -> Pipe<typename is_pipe_mapper_v2<FUNC, T>::mapped_type> {
+        -> Pipe<typename pipe_unwrap<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::type> {
             return map11_v2(N, func);
         }
 
@@ -495,7 +518,7 @@ namespace ohm {
                  std::is_move_constructible<FUNC>::value) &&
                 is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::value>::type>
         auto map(size_t N, FUNC func, IsMap1x= {})
-        -> Pipe<typename is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::return_type> {
+        -> Pipe<typename pipe_unwrap<typename is_data_generator<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::return_type>::type> {
             return map1x_v2(N, func);
         }
 
@@ -512,7 +535,7 @@ namespace ohm {
                 is_pipe_mapper<FUNC, T>::value &&
                 (std::is_copy_constructible<FUNC>::value ||
                  std::is_move_constructible<FUNC>::value)>::type>
-        auto map(FUNC func) -> Pipe<typename is_pipe_mapper<FUNC, T>::mapped_type> {
+        auto map(FUNC func) -> Pipe<typename pipe_unwrap<typename is_pipe_mapper<FUNC, T>::mapped_type>::type> {
             return this->map(0, func);
         }
 
@@ -529,7 +552,7 @@ namespace ohm {
                 is_pipe_mapper_v2<FUNC, T>::value &&
                 (std::is_copy_constructible<FUNC>::value ||
                  std::is_move_constructible<FUNC>::value)>::type>
-        auto map(FUNC func) -> Pipe<typename is_pipe_mapper_v2<FUNC, T>::mapped_type> {
+        auto map(FUNC func) -> Pipe<typename pipe_unwrap<typename is_pipe_mapper_v2<FUNC, T>::mapped_type>::type> {
             return this->map(0, func);
         }
 
@@ -559,6 +582,126 @@ namespace ohm {
             return this->map(0, mapper);
         }
 
+        /**
+         *
+         * @tparam FUNC map function type
+         * @param N number of thread using
+         * @param func map function, generate 1 data from 1 data. throw PipeLeak for no data generated
+         * @param window max number of data processing or waiting for earlier data, 0 means 2 * N.
+         * @return mapped pipe, called child pipe, data are in the same order as this pipe.
+         * Notice the child pipe has already relied on this parent pipe.
+         * `SO` do not capture parent or parent's parent in map API of child pipe.
+         * It may cause circular reference.
+         * @notice reorder buffer occupancy is reported as metric "reorder" of this pipe's profile.
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                is_pipe_mapper<FUNC, T>::value &&
+                (std::is_copy_constructible<FUNC>::value ||
+                 std::is_move_constructible<FUNC>::value)>::type>
+        auto map11_ordered(size_t N, FUNC func, size_t window = 0)
+        -> Pipe<typename pipe_unwrap<typename is_pipe_mapper<FUNC, T>::mapped_type>::type> {
+            using mapped_type = typename pipe_unwrap<typename is_pipe_mapper<FUNC, T>::mapped_type>::type;
+            return map_ordered_with<mapped_type>(N, window,
+                    [func](T data, std::vector<mapped_type> &outputs) {
+                        emit(outputs, func(std::move(data)));
+                    });
+        }
+
+        /**
+         *
+         * @tparam FUNC map function type
+         * @param N number of thread using
+         * @param func map function, return iterable range value, like vector or list
+         * @param window max number of data processing or waiting for earlier data, 0 means 2 * N.
+         * @return mapped pipe, called child pipe, data are in the same order as this pipe.
+         * Notice the child pipe has already relied on this parent pipe.
+         * `SO` do not capture parent or parent's parent in map API of child pipe.
+         * It may cause circular reference.
+         * @notice reorder buffer occupancy is reported as metric "reorder" of this pipe's profile.
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                is_pipe_mapper<FUNC, T>::value &&
+                (std::is_copy_constructible<FUNC>::value ||
+                 std::is_move_constructible<FUNC>::value) &&
+                is_iterable<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
+        auto map1n_ordered(size_t N, FUNC func, size_t window = 0)
+        -> Pipe<typename has_iterator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value_type> {
+            using mapped_type = typename has_iterator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value_type;
+            return map_ordered_with<mapped_type>(N, window,
+                    [func](T data, std::vector<mapped_type> &outputs) {
+                        auto range = func(std::move(data));
+                        for (auto &&out : range) {
+                            outputs.push_back(std::move(out));
+                        }
+                    });
+        }
+
+        /**
+         *
+         * @tparam FUNC map function type
+         * @param N number of thread using
+         * @param func map function, return data generator(function return one data for each call).
+         * @param window max number of data processing or waiting for earlier data, 0 means 2 * N.
+         * @return mapped pipe, called child pipe, data are in the same order as this pipe.
+         * Notice the child pipe has already relied on this parent pipe.
+         * `SO` do not capture parent or parent's parent in map API of child pipe.
+         * It may cause circular reference.
+         * @notice reorder buffer occupancy is reported as metric "reorder" of this pipe's profile.
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                is_pipe_mapper<FUNC, T>::value &&
+                (std::is_copy_constructible<FUNC>::value ||
+                 std::is_move_constructible<FUNC>::value) &&
+                is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
+        auto map1x_ordered(size_t N, FUNC func, size_t window = 0)
+        -> Pipe<typename pipe_unwrap<typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type>::type> {
+            using mapped_type = typename pipe_unwrap<
+                    typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type>::type;
+            return map_ordered_with<mapped_type>(N, window,
+                    [func](T data, std::vector<mapped_type> &outputs) {
+                        auto generator = func(std::move(data));
+                        drain(generator, outputs);
+                    });
+        }
+
+        /**
+         * Same as `map`, but keep data order by reorder buffer.
+         * @param N number of thread using
+         * @param func map function, could be map11 map1n and map1x function
+         * @param window max number of data processing or waiting for earlier data, 0 means 2 * N.
+         * @return mapped pipe, called child pipe, data are in the same order as this pipe.
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                is_pipe_mapper<FUNC, T>::value &&
+                (std::is_copy_constructible<FUNC>::value ||
+                 std::is_move_constructible<FUNC>::value) &&
+                !is_iterable<typename is_pipe_mapper<FUNC, T>::mapped_type>::value &&
+                !is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
+        auto map_ordered(size_t N, FUNC func, size_t window = 0, IsMap11= {})
+        -> Pipe<typename pipe_unwrap<typename is_pipe_mapper<FUNC, T>::mapped_type>::type> {
+            return map11_ordered(N, func, window);
+        }
+
+        template<typename FUNC, typename=typename std::enable_if<
+                is_pipe_mapper<FUNC, T>::value &&
+                (std::is_copy_constructible<FUNC>::value ||
+                 std::is_move_constructible<FUNC>::value) &&
+                is_iterable<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
+        auto map_ordered(size_t N, FUNC func, size_t window = 0, IsMap1n= {})
+        -> Pipe<typename has_iterator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value_type> {
+            return map1n_ordered(N, func, window);
+        }
+
+        template<typename FUNC, typename=typename std::enable_if<
+                is_pipe_mapper<FUNC, T>::value &&
+                (std::is_copy_constructible<FUNC>::value ||
+                 std::is_move_constructible<FUNC>::value) &&
+                is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::value>::type>
+        auto map_ordered(size_t N, FUNC func, size_t window = 0, IsMap1x= {})
+        -> Pipe<typename pipe_unwrap<typename is_data_generator<typename is_pipe_mapper<FUNC, T>::mapped_type>::return_type>::type> {
+            return map1x_ordered(N, func, window);
+        }
+
         /**
          *
          * @param N number of thread using
@@ -571,10 +714,10 @@ namespace ohm {
         void seal(size_t N, FUNC func) {
             auto processor = [this, func](T data) {
                 try {
-                    func(data);
+                    func(std::move(data));
                 } catch (const PipeLeak &) {}
             };
-            if (N == 0) {
+            if (N == 0 || fusable(N)) {
                 m_queue->bind(processor, true);
             } else {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
@@ -607,9 +750,9 @@ namespace ohm {
                  std::is_move_constructible<FUNC>::value)>::type>
         void seal(size_t N, FUNC func, IsSealV2 = {}) {
             auto get_processor = [this, func](int i) {
-                auto processor = [this, func, i](T data) {
+                return [this, func, i](T data) {
                     try {
-                        func(i, data);
+                        func(i, std::move(data));
                     } catch (const PipeLeak &) {}
                 };
             };
@@ -635,13 +778,15 @@ namespace ohm {
         class Diverter {
         public:
             template<typename I, typename = typename std::is_integral<I>::type>
-            Diverter(I size, std::shared_ptr<PipeProfiler> profiler)
-                    : m_pipes(size_t(size), profiler) {
+            Diverter(I size, std::shared_ptr<PipeProfiler> profiler) {
+                // each case must have its own queue, so do not copy one pipe.
+                m_pipes.reserve(size_t(size));
+                for (size_t i = 0; i < size_t(size); ++i) m_pipes.emplace_back(profiler);
             }
 
             template<typename I, typename = typename std::is_integral<I>::type>
             Diverter(I size)
-                    : m_pipes(size_t(size)) {
+                    : Diverter(size, std::make_shared<PipeProfiler>()) {
             }
 
             template<typename I, typename = typename std::is_integral<I>::type>
@@ -658,12 +803,41 @@ namespace ohm {
                 return m_pipes.size();
             }
 
+            /**
+             * Set limit and mode of every case, like `Pipe::limit`.
+             * @param limit max size of each case
+             * @param mode what to do when case is full, DISPATCH_KEEP_WAIT slows down dispatching.
+             * @return self
+             */
+            Diverter &limit(int64_t limit, DispatcherMode mode = DISPATCH_KEEP_WAIT) {
+                for (auto &pipe : m_pipes) pipe.limit(limit).mode(mode);
+                return *this;
+            }
+
+            /**
+             * Set limit and mode of one case, like shorter queue for slower replica.
+             * @param index case index
+             * @param limit max size of case
+             * @param mode what to do when case is full
+             * @return self
+             */
+            Diverter &limit(size_t index, int64_t limit, DispatcherMode mode) {
+                m_pipes[index].limit(limit).mode(mode);
+                return *this;
+            }
+
             void join() {
                 for (auto &pipe : m_pipes) {
                     pipe.join();
                 }
             }
 
+            void close() {
+                for (auto &pipe : m_pipes) {
+                    pipe.close();
+                }
+            }
+
         private:
             Diverter(std::vector<Pipe<T>> pipes)
                     : m_pipes(std::move(pipes)) {
@@ -683,6 +857,7 @@ namespace ohm {
          * @param N number of thread using
          * @param case_number dispatch case number
          * @param func dispatch function, return case number, means the data will send to witch case.
+         *             take `const T &` to avoid copying data, data will be moved to the case.
          * @return diverter, contains number of case pipes.
          * Notice the child pipe has already relied on this parent pipe.
          * `SO` do not capture parent or parent's parent in map API of child pipe.
@@ -696,10 +871,9 @@ namespace ohm {
             Diverter diverter(case_number, m_profiler);
             auto processor = [this, case_number, diverter, func](T data) {
                 try {
-                    auto number = int(func(data));
-                    auto &cases = const_cast<Diverter &>(diverter);
+                    auto number = int(func(static_cast<const T &>(data)));
                     if (number < 0 || number >= int(case_number)) return;
-                    const_cast<Diverter &>(diverter)[number].push(data);
+                    const_cast<Diverter &>(diverter)[number].push(std::move(data));
                 } catch (const PipeLeak &) {}
             };
             if (N == 0) {
@@ -708,6 +882,7 @@ namespace ohm {
                 for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
             }
             m_join_links->emplace_back([diverter]() { const_cast<Diverter &>(diverter).join(); });
+            m_queue->on_finished([diverter]() { const_cast<Diverter &>(diverter).close(); });
             return diverter;
         }
 
@@ -717,6 +892,7 @@ namespace ohm {
          * @tparam FUNC dispatch function type
          * @param case_number dispatch case number
          * @param func dispatch function, return case number, means the data will send to witch case.
+         *             take `const T &` to avoid copying data, data will be moved to the case.
          * @return diverter, contains number of case pipes.
          * Notice the child pipe has already relied on this parent pipe.
          * `SO` do not capture parent or parent's parent in map API of child pipe.
@@ -730,6 +906,95 @@ namespace ohm {
             return this->template dispatch(0, case_number, func);
         }
 
+        /**
+         * Dispatch each data to one of cases doing same work by `balancing`, like replicas of one model.
+         * @param N number of thread using
+         * @param case_number dispatch case number
+         * @param balancing how to pick case, load-aware ones read queue length of cases,
+         *                  so set limits of cases with `Diverter::limit` to keep queues short.
+         * @return diverter, contains number of case pipes.
+         * Notice the child pipe has already relied on this parent pipe.
+         * `SO` do not capture parent or parent's parent in map API of child pipe.
+         * It may cause circular reference.
+         */
+        auto dispatch(size_t N, size_t case_number, const PipeBalancing &balancing) -> Diverter {
+            Diverter diverter(case_number, m_profiler);
+            auto balancer = std::make_shared<PipeBalancer>(case_number, balancing);
+            auto processor = [diverter, balancer](T data) {
+                auto &cases = const_cast<Diverter &>(diverter);
+                auto number = balancer->pick([&cases](size_t i) {
+                    return int64_t(cases[i].queue().size());
+                });
+                cases[number].push(std::move(data));
+            };
+            if (N == 0) {
+                m_queue->bind(processor, true);
+            } else {
+                for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
+            }
+            m_join_links->emplace_back([diverter]() { const_cast<Diverter &>(diverter).join(); });
+            m_queue->on_finished([diverter]() { const_cast<Diverter &>(diverter).close(); });
+            return diverter;
+        }
+
+        /**
+         * Dispatch each data to one of cases by `balancing`, in pushing thread.
+         * @param case_number dispatch case number
+         * @param balancing how to pick case
+         * @return diverter, contains number of case pipes.
+         */
+        auto dispatch(size_t case_number, const PipeBalancing &balancing) -> Diverter {
+            return dispatch(0, case_number, balancing);
+        }
+
+        /**
+         * Shared immutable view of data, given to each branch of broadcast.
+         */
+        using Shared = std::shared_ptr<const T>;
+
+        /**
+         * Broadcast each data to all branches without copying.
+         * Data is moved into one shared object, each branch gets a pointer of it.
+         * Each branch has its own limit and mode, so slow branch can use `keep_new` to drop data without
+         * slowing down other branches.
+         * @param N number of thread using
+         * @param branch_number number of branches
+         * @return diverter, contains number of branch pipes.
+         * Notice the child pipe has already relied on this parent pipe.
+         * `SO` do not capture parent or parent's parent in map API of child pipe.
+         * It may cause circular reference.
+         */
+        template<typename U = T>
+        auto broadcast(size_t N, size_t branch_number) -> typename Pipe<std::shared_ptr<const U>>::Diverter {
+            using Branches = typename Pipe<Shared>::Diverter;
+            Branches branches(branch_number, m_profiler);
+            auto processor = [branches](T data) {
+                auto &pipes = const_cast<Branches &>(branches);
+                Shared shared = std::make_shared<const T>(std::move(data));
+                for (size_t i = 0; i < pipes.size(); ++i) {
+                    pipes[i].push(shared);
+                }
+            };
+            if (N == 0) {
+                m_queue->bind(processor, true);
+            } else {
+                for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
+            }
+            m_join_links->emplace_back([branches]() { const_cast<Branches &>(branches).join(); });
+            m_queue->on_finished([branches]() { const_cast<Branches &>(branches).close(); });
+            return branches;
+        }
+
+        /**
+         * Broadcast each data to all branches without copying, in pushing thread.
+         * @param branch_number number of branches
+         * @return diverter, contains number of branch pipes.
+         */
+        template<typename U = T>
+        auto broadcast(size_t branch_number) -> typename Pipe<std::shared_ptr<const U>>::Diverter {
+            return broadcast<U>(0, branch_number);
+        }
+
         /**
          * @param N number of thread using
          * @param func function
@@ -740,6 +1005,7 @@ namespace ohm {
          */
         template<typename FUNC, typename=typename std::enable_if<
                 is_pipe_mapper<FUNC, T>::value &&
+                std::is_copy_constructible<T>::value &&
                 (std::is_copy_constructible<FUNC>::value ||
                  std::is_move_constructible<FUNC>::value)>::type>
         auto parallel(size_t N, FUNC func) -> Pipe<T> {
@@ -750,15 +1016,15 @@ namespace ohm {
 
             auto processor = [this, parallel_mapped, mapped, func](T data) {
                 try {
-                    const_cast<Pipe<T> &>(mapped).push(data);
+                    const_cast<Pipe<T> &>(parallel_mapped).push(data);
                 } catch (const PipeLeak &) {}
                 try {
-                    const_cast<Pipe<T> &>(parallel_mapped).push(data);
+                    const_cast<Pipe<T> &>(mapped).push(std::move(data));
                 } catch (const PipeLeak &) {}
             };
             m_queue->bind(processor, true);
-            m_join_links->emplace_back([parallel_mapped]() { const_cast<Pipe<T> &>(parallel_mapped).join(); });
-            m_join_links->emplace_back([mapped]() { const_cast<Pipe<T> &>(mapped).join(); });
+            link(parallel_mapped);
+            link(mapped);
             return mapped;
         }
 
@@ -771,6 +1037,7 @@ namespace ohm {
          */
         template<typename FUNC, typename=typename std::enable_if<
                 is_pipe_mapper<FUNC, T>::value &&
+                std::is_copy_constructible<T>::value &&
                 (std::is_copy_constructible<FUNC>::value ||
                  std::is_move_constructible<FUNC>::value)>::type>
         auto parallel(FUNC func) -> Pipe<T> {
@@ -788,6 +1055,246 @@ namespace ohm {
             return *this;
         }
 
+        /**
+         * set number of values each worker drains from queue at one time.
+         * @param size batch size
+         * @return self
+         * @notice useful for small data, that lock and wakeup cost more than processing.
+         */
+        self &batch(size_t size) {
+            m_queue->batch(size);
+            return *this;
+        }
+
+        /**
+         * set queue storage, ring storages are lock-free.
+         * @param storage storage type
+         * @param capacity ring capacity, 0 means using limit.
+         * @return self
+         * @notice must be called before this pipe mapped or sealed.
+         */
+        self &storage(DispatcherStorage storage, size_t capacity = 0) {
+            m_queue->storage(storage, capacity);
+            return *this;
+        }
+
+        /**
+         * Split queue of this pipe into priority lanes, workers always serve lane 0 first.
+         * @param size number of lanes
+         * @param classifier take `const T &`, return lane index, out of range index means the last lane.
+         * @param aging value waited longer than `aging` is served before values of higher lanes, 0 means never.
+         * @return self
+         * @notice must be called before this pipe mapped or sealed.
+         * @notice depth, smoothed waiting time and dropped count of each lane are reported as metrics
+         *         "lane<i>.depth", "lane<i>.wait_us" and "lane<i>.dropped" after profiled.
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                std::is_constructible<std::function<size_t(const T &)>, FUNC>::value>::type>
+        self &lanes(size_t size, FUNC classifier, time::us aging = time::us(0)) {
+            m_queue->lanes(size, aging);
+            m_queue->classify(classifier);
+            std::weak_ptr<DispatcherQueue<T>> weak = m_queue;
+            for (size_t i = 0; i < size; ++i) {
+                auto prefix = "lane" + std::to_string(i) + ".";
+                metric(prefix + "depth", [weak, i]() -> int64_t {
+                    auto queue = weak.lock();
+                    return queue ? queue->lane_size(i) : 0;
+                });
+                metric(prefix + "wait_us", [weak, i]() -> int64_t {
+                    auto queue = weak.lock();
+                    return queue ? queue->lane_wait(i) : 0;
+                });
+                metric(prefix + "dropped", [weak, i]() -> int64_t {
+                    auto queue = weak.lock();
+                    return queue ? queue->lane_dropped(i) : 0;
+                });
+            }
+            return *this;
+        }
+
+        /**
+         * Set limit and mode of one lane, used instead of limit and mode of pipe.
+         * @param index lane index
+         * @param limit max size of lane, 0 means using limit of pipe
+         * @param mode what to do when lane is full, DISPATCH_KEEP_NEW is usual for routine lanes.
+         * @return self
+         */
+        self &lane(size_t index, int64_t limit, DispatcherMode mode) {
+            m_queue->lane(index, limit, mode);
+            return *this;
+        }
+
+        /**
+         * Discard value waited longer than `ttl` in queue of this pipe, checked when workers take it.
+         * @param ttl max waiting time
+         * @return self
+         * @notice must be called before this pipe mapped or sealed, only work with DISPATCH_STORAGE_DEQUE.
+         * @notice number of discarded values is reported as metric "expired" after profiled.
+         */
+        self &ttl(time::us ttl) {
+            m_queue->ttl(ttl);
+            report_expired();
+            return *this;
+        }
+
+        /**
+         * Discard value whose deadline passed, checked when workers take it.
+         * @param deadline take `const T &`, return `std::chrono::steady_clock::time_point`
+         * @return self
+         * @notice must be called before this pipe mapped or sealed.
+         * @notice number of discarded values is reported as metric "expired" after profiled.
+         */
+        template<typename FUNC, typename=typename std::enable_if<std::is_constructible<
+                std::function<std::chrono::steady_clock::time_point(const T &)>, FUNC>::value>::type>
+        self &deadline(FUNC deadline) {
+            m_queue->deadline(deadline);
+            report_expired();
+            return *this;
+        }
+
+        /**
+         * Count bytes of data waiting in this pipe, reported as metric "bytes" of profile.
+         * @tparam FUNC sizer function type
+         * @param sizer take `const T &`, return estimated bytes of data, same data must have same bytes.
+         * @param limit max bytes of data waiting in this pipe, 0 means no limit.
+         * @return self
+         * @notice byte limits work with current mode like `limit`, data pushed to empty pipe is always accepted.
+         * @notice only work with DISPATCH_STORAGE_DEQUE, must be called when pipe is empty.
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                std::is_constructible<std::function<int64_t(const T &)>, FUNC>::value>::type>
+        self &bytes(FUNC sizer, int64_t limit = 0) {
+            m_queue->sizer(sizer);
+            m_queue->byte_limit(limit);
+            for (auto &metric : m_stage->metrics) {
+                if (metric.first == "bytes") return *this;
+            }
+            std::weak_ptr<DispatcherQueue<T>> weak = m_queue;
+            metric("bytes", [weak]() -> int64_t {
+                auto queue = weak.lock();
+                return queue ? queue->bytes() : 0;
+            });
+            return *this;
+        }
+
+        /**
+         * Limit bytes of data waiting in this pipe, see `bytes`.
+         * @param limit max bytes, 0 means no limit.
+         * @return self
+         */
+        self &byte_limit(int64_t limit) {
+            m_queue->byte_limit(limit);
+            return *this;
+        }
+
+        /**
+         * Limit total bytes of data waiting in all pipes of this graph counting bytes, see `bytes`.
+         * Shared by this pipe and pipes mapped after, usually called on root pipe.
+         * @param limit max bytes, 0 means no limit.
+         * @return self
+         * @notice full budget works with current mode of each pipe like `limit`,
+         *         waiting pushes are woken when any pipe releases bytes.
+         */
+        self &budget(int64_t limit) {
+            if (!m_profiler) m_profiler.reset(new PipeProfiler);
+            m_profiler->budget(limit);
+            if (m_queue->budget() != m_profiler->budget()) m_queue->budget(m_profiler->budget());
+            return *this;
+        }
+
+        /**
+         * Report statistics of buffer pool used by this pipe's data, as metrics of profile:
+         * "pool_hits" and "pool_misses" of acquiring, "pool_used" and "pool_cached" bytes.
+         * @param pool buffer pool
+         * @return self
+         */
+        self &pool(const PipeBufferPool &pool) {
+            metric("pool_hits", [pool]() -> int64_t { return pool.stats().hits; });
+            metric("pool_misses", [pool]() -> int64_t { return pool.stats().misses; });
+            metric("pool_used", [pool]() -> int64_t { return pool.stats().used; });
+            metric("pool_cached", [pool]() -> int64_t { return pool.stats().cached; });
+            return *this;
+        }
+
+        /**
+         * set how workers of this pipe wait for data, and how pushing thread waits for space.
+         * @param policy waiting policy
+         * @param spin number of spins before yielding, 0 means default.
+         * @return self
+         * @notice spinning and polling trade CPU for wakeup latency, use them for sub-millisecond stages only.
+         */
+        self &waiting(DispatcherWait policy, size_t spin = 0) {
+            m_queue->waiting(policy, spin);
+            return *this;
+        }
+
+        /**
+         * set CPU affinity, NUMA node and priority of workers of this pipe.
+         * @param placement see `ThreadPlacement`, unsupported settings are skipped.
+         * @return self
+         * @notice must be called before `map` or `seal`, not applied when running on shared executor.
+         */
+        self &placement(ThreadPlacement placement) {
+            m_queue->placement(std::move(placement));
+            return *this;
+        }
+
+        /**
+         * Run this pipe and all pipes mapped after on shared work-stealing pool, instead of threads of each stage.
+         * The `N` of map or seal becomes the max concurrency of that stage.
+         * @param pool shared pool, nullptr means creating one with number of hardware threads.
+         * @return self
+         * @notice must be called before this pipe mapped or sealed, usually on the root pipe.
+         */
+        self &executor(std::shared_ptr<WorkStealingPool> pool = nullptr) {
+            if (!pool) pool = std::make_shared<WorkStealingPool>();
+            if (!m_profiler) m_profiler.reset(new PipeProfiler);
+            m_profiler->executor(pool);
+            m_queue->executor(pool);
+            return *this;
+        }
+
+        /**
+         * Trace each value from this pipe to sinks.
+         * Profiled pipes mapped after report queue-wait, service time and latency from this pipe
+         * as percentiles in `PipeProfiler::Report::Line::trace`, the latency of sealed pipe is end-to-end latency.
+         * Service time of stage excludes time of stages fused after it, see `fuse`.
+         * @return self
+         * @notice must be called before this pipe mapped or sealed, usually on the root pipe.
+         * @notice values are stamped in queue, pipes with ring storage do not trace.
+         */
+        self &trace() {
+            if (!m_profiler) m_profiler.reset(new PipeProfiler);
+            m_profiler->trace(true);
+            m_queue->trace(true);
+            if (!m_stage->name.empty()) profile(m_stage->name);
+            return *this;
+        }
+
+        /**
+         * Fuse adjacent 1:1 stages of this graph mapped after, to save queue hops between cheap functions.
+         * `map(N, b)` or `seal(N, b)` on a pipe fed by `map(N, a)` with the same `N` runs `b` directly in workers of `a`,
+         * the queue between them is skipped. Each fused function keeps its own profile line, timed exclusively.
+         * Pipes with queue settings are not fused: storage, lanes, ttl, deadline, placement, or not keep_wait mode.
+         * @param on fuse or not
+         * @return self
+         * @notice fused functions are shared by workers of feeding stage, make sure they are thread-safe;
+         *         mappers taking worker index are never fused.
+         * @notice fused pipe must have only one consumer stage.
+         */
+        self &fuse(bool on = true) {
+            if (!m_profiler) m_profiler.reset(new PipeProfiler);
+            m_profiler->fuse(on);
+            return *this;
+        }
+
+        /**
+         * @return if stage mapped on this pipe runs directly in workers feeding this pipe
+         */
+        bool fused() const {
+            return m_stage->feeders > 0 && m_queue->intime();
+        }
+
         /**
          * Join to wait all data finish. if `recursion`, wait all child finish.
          * @param recursion
@@ -801,6 +1308,72 @@ namespace ohm {
             }
         }
 
+        /**
+         * Let `join` of this pipe also join `child`, for stages built outside of this pipe, like merge.
+         * @param child child pipe fed by this pipe
+         * @return self
+         */
+        template<typename U>
+        self &attach(const Pipe<U> &child) {
+            m_join_links->emplace_back([child]() { const_cast<Pipe<U> &>(child).join(); });
+            return *this;
+        }
+
+        /**
+         * Tell no more data will be pushed, end of stream.
+         * Data left are still processed, after that child pipes are closed, stage by stage.
+         * Workers exit after their pipe closed and drained.
+         * @notice push to closed pipe throws Exception.
+         */
+        void close() {
+            m_queue->close();
+        }
+
+        /**
+         * @return if all data processed after closed
+         */
+        bool finished() const {
+            return m_queue->finished();
+        }
+
+        /**
+         * Get future of the whole graph, ready when all pipes sharing the same root closed and drained.
+         * Used to start next job right after this graph done.
+         * @return completion future
+         */
+        std::shared_future<void> completion() const {
+            if (!m_profiler) {
+                std::promise<void> done;
+                done.set_value();
+                return done.get_future().share();
+            }
+            return m_profiler->completion()->future();
+        }
+
+        /**
+         * Do profile by given name, with sampling policy of timing and tracing.
+         * Counts and rates are exact, processing time and trace distributions come from sampled values.
+         * @param name profile's queue name
+         * @param sampling which values are timed and traced, see `DispatcherSampling`
+         * @return self
+         * @notice time of fused stage not sampled is counted in the stage before, see `fuse`.
+         */
+        self &profile(const std::string &name, const DispatcherSampling &sampling) {
+            profile(name);
+            m_queue->sampling(sampling);
+            return *this;
+        }
+
+        /**
+         * Change sampling policy of this pipe at any time, see `profile`.
+         * @param sampling which values are timed and traced
+         * @return self
+         */
+        self &sampling(const DispatcherSampling &sampling) {
+            m_queue->sampling(sampling);
+            return *this;
+        }
+
         /**
          * Do profile by given name
          * @param name profile's queue name
@@ -808,6 +1381,10 @@ namespace ohm {
          */
         self &profile(const std::string &name) {
             if (!m_profiler) m_profiler.reset(new PipeProfiler);
+            m_stage->name = name;
+            for (auto &metric : m_stage->metrics) {
+                m_profiler->metric(name, metric.first, metric.second);
+            }
             auto queue = m_queue;
             auto callback = m_profiler->callback(
                     name,
@@ -816,9 +1393,29 @@ namespace ohm {
                     },
                     [queue]() -> int64_t {
                         return int64_t(queue->threads());
+                    },
+                    [queue](int64_t threads) {
+                        queue->resize(size_t(threads));
                     });
-            m_queue->set_io_action(callback.in, callback.out);
+            m_profiler->sampler(name, [queue](const DispatcherSampling &sampling) {
+                queue->sampling(sampling);
+            });
+            m_queue->set_io_counter(callback.inputs, callback.outputs);
             m_queue->set_time_reporter(callback.time);
+            if (m_queue->tracing()) m_queue->set_trace_reporter(callback.trace);
+            return *this;
+        }
+
+        /**
+         * Add named metric, reported in the profile line of this pipe.
+         * Metric added before `profile(name)` will be reported after profiling.
+         * @param name metric name
+         * @param getter read metric value when reporting
+         * @return self
+         */
+        self &metric(const std::string &name, const PipeProfiler::Getter<int64_t> &getter) {
+            m_stage->metrics.emplace_back(name, getter);
+            if (!m_stage->name.empty() && m_profiler) m_profiler->metric(m_stage->name, name, getter);
             return *this;
         }
 
@@ -829,6 +1426,7 @@ namespace ohm {
         self &profile(std::nullptr_t) {
             m_queue->clear_io_action();
             m_queue->clear_time_reporter();
+            m_queue->clear_trace_reporter();
             return *this;
         }
 
@@ -844,6 +1442,11 @@ namespace ohm {
             }
         }
 
+        /**
+         * @return profiler shared by pipes of this graph
+         */
+        std::shared_ptr<PipeProfiler> profiler() const { return m_profiler; }
+
         DispatcherQueue<T> &queue() { return *m_queue; }
 
         const DispatcherQueue<T> &queue() const { return *m_queue; }
@@ -868,17 +1471,170 @@ namespace ohm {
             return *this;
         }
 
+        self &mode(DispatcherMode mode) {
+            m_queue->mode(mode);
+            return *this;
+        }
+
         void dispose() {
             m_queue.template reset(new DispatcherQueue<T>);
             m_join_links.template reset(new std::vector<std::function<void(void)>>);
             m_profiler.reset();
+            m_stage.reset(new Stage);
         }
 
     private:
+        template<typename U>
+        friend class Pipe;
+
+        /**
+         * Shared by copies of pipe, for things set after mapping.
+         */
+        struct Stage {
+            std::string name;   ///< profile name, empty if not profiled
+            size_t feeders = 0; ///< workers of 1:1 stage pushing into this pipe, 0 if not fed by one
+            std::vector<std::pair<std::string, PipeProfiler::Getter<int64_t>>> metrics;
+        };
+
+        /**
+         * @return if stage with `N` workers mapped on this pipe could be fused into stage feeding this pipe
+         */
+        bool fusable(size_t N) const {
+            return N > 0 && m_profiler && m_profiler->fusing() && m_stage->feeders == N
+                   && !m_queue->binded()
+                   && m_queue->storage() == DISPATCH_STORAGE_DEQUE
+                   && m_queue->mode() == DISPATCH_KEEP_WAIT
+                   && m_queue->lanes() == 1
+                   && m_queue->ttl().count() == 0
+                   && !m_queue->has_deadline()
+                   && !m_queue->ticketing()
+                   && m_queue->placement().empty();
+        }
+
+        /**
+         * Push mapped data to pipe, empty `PipeMaybe` pushes nothing.
+         */
+        template<typename U>
+        static void emit(Pipe<U> &pipe, U data) {
+            pipe.push(std::move(data));
+        }
+
+        template<typename U>
+        static void emit(Pipe<U> &pipe, PipeMaybe<U> data) {
+            if (data) pipe.push(data.take());
+        }
+
+        template<typename U>
+        static void emit(std::vector<U> &outputs, U data) {
+            outputs.push_back(std::move(data));
+        }
+
+        template<typename U>
+        static void emit(std::vector<U> &outputs, PipeMaybe<U> data) {
+            if (data) outputs.push_back(data.take());
+        }
+
+        /**
+         * Emit all data of generator to `sink`, until generator throws PipeBreak or returns empty `PipeMaybe`.
+         */
+        template<typename G, typename SINK>
+        static void drain(G &generator, SINK &sink) {
+            drain(generator, sink, is_pipe_maybe<typename std::decay<decltype(generator())>::type>());
+        }
+
+        template<typename G, typename SINK>
+        static void drain(G &generator, SINK &sink, std::false_type) {
+            try {
+                while (true) {
+                    emit(sink, generator());
+                }
+            } catch (const PipeBreak &) {}
+        }
+
+        template<typename G, typename SINK>
+        static void drain(G &generator, SINK &sink, std::true_type) {
+            while (true) {
+                auto next = generator();
+                if (!next) return;
+                emit(sink, std::move(next));
+            }
+        }
+
+        void report_expired() {
+            for (auto &metric : m_stage->metrics) {
+                if (metric.first == "expired") return;
+            }
+            std::weak_ptr<DispatcherQueue<T>> weak = m_queue;
+            metric("expired", [weak]() -> int64_t {
+                auto queue = weak.lock();
+                return queue ? queue->expired() : 0;
+            });
+        }
+
+        /**
+         * Join and close child with this pipe.
+         */
+        template<typename U>
+        void link(const Pipe<U> &child) {
+            m_join_links->emplace_back([child]() { const_cast<Pipe<U> &>(child).join(); });
+            m_queue->on_finished([child]() { const_cast<Pipe<U> &>(child).close(); });
+        }
+
+        /**
+         * Bind workers restoring data order.
+         * @param process process one data, fill outputs of it.
+         */
+        template<typename U, typename FUNC>
+        Pipe<U> map_ordered_with(size_t N, size_t window, FUNC process) {
+            Pipe<U> mapped(m_profiler);
+            if (N <= 1) {
+                // one worker or intime, data are already in order
+                auto processor = [mapped, process](T data) {
+                    std::vector<U> outputs;
+                    try {
+                        process(std::move(data), outputs);
+                    } catch (const PipeLeak &) {}
+                    auto &pipe = const_cast<Pipe<U> &>(mapped);
+                    for (auto &out : outputs) pipe.push(std::move(out));
+                };
+                m_queue->bind(processor, N == 0);
+                link(mapped);
+                return mapped;
+            }
+            if (window == 0) window = N * 2;
+            auto reorder = std::make_shared<PipeReorder<U>>(window, [mapped](U data) {
+                const_cast<Pipe<U> &>(mapped).push(std::move(data));
+            });
+            auto processor = [reorder, process](T data) {
+                auto ticket = DispatcherQueue<T>::ticket();
+                reorder->wait(ticket);
+                std::vector<U> outputs;
+                try {
+                    process(std::move(data), outputs);
+                } catch (const PipeLeak &) {
+                } catch (...) {
+                    // still finish the ticket, or later data will wait forever
+                    reorder->done(ticket, std::vector<U>());
+                    throw;
+                }
+                reorder->done(ticket, std::move(outputs));
+            };
+            m_queue->ticketing(true);
+            for (decltype(N) i = 0; i < N; ++i) m_queue->bind(processor);
+            std::weak_ptr<PipeReorder<U>> weak = reorder;
+            metric("reorder", [weak]() -> int64_t {
+                auto reorder = weak.lock();
+                return reorder ? reorder->occupancy() : 0;
+            });
+            link(mapped);
+            return mapped;
+        }
+
         std::shared_ptr<DispatcherQueue<T>> m_queue;
         std::shared_ptr<std::vector<std::function<void(void)>>> m_join_links;
 
         std::shared_ptr<PipeProfiler> m_profiler;
+        std::shared_ptr<Stage> m_stage;
     };
 
     template<>
@@ -935,7 +1691,8 @@ namespace ohm {
         auto tmp = std::make_shared<Local>(std::move(range));
         return [tmp]() -> typename has_iterator<Range>::value_type {
             if (tmp->it == tmp->range.end()) throw PipeBreak();
-            return *(tmp->it)++;
+            // the range is owned by generator, each value only be generated once.
+            return std::move(*(tmp->it)++);
         };
     }
 
@@ -963,6 +1720,7 @@ namespace ohm {
         using self = Tap;
 
         using Generator = std::function<T()>;
+        using Timestamp = std::function<time::us(const T &)>;
 
         /**
          * Set generater to generate data to Tap
@@ -973,7 +1731,57 @@ namespace ohm {
         template<typename FUNC, typename=typename std::enable_if<
                 std::is_constructible<Generator, FUNC>::value>::type>
         explicit Tap(FUNC func)
-                : m_generator(func) {}
+                : m_state(new State) {
+            m_state->sources.emplace_back(Generator(func));
+        }
+
+        struct IsMaybe {
+        };
+
+        /**
+         * Set generater returning `PipeMaybe<T>`, empty value tells no data will generate.
+         * @tparam FUNC generator function type
+         * @param func generator function
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                !std::is_constructible<Generator, FUNC>::value &&
+                std::is_constructible<std::function<PipeMaybe<T>()>, FUNC>::value>::type>
+        explicit Tap(FUNC func, IsMaybe = {})
+                : self(Generator([func]() -> T {
+                    auto next = func();
+                    if (!next) throw PipeBreak();
+                    return next.take();
+                })) {}
+
+        /**
+         * Set generators of sources, each source generates data in its own thread in `loop`.
+         * @param generators generator of each source
+         * @notice each generator could throw PipeBreak to tell its source ends, Tap ends after all sources end.
+         */
+        explicit Tap(const std::vector<Generator> &generators)
+                : m_state(new State) {
+            if (generators.empty()) throw Exception("Tap needs at least one generator.");
+            for (auto &generator : generators) m_state->sources.emplace_back(generator);
+        }
+
+        /**
+         * Set `N` sources sharing one generator, which takes source index as first parameter, used to tag data.
+         * @tparam FUNC generator function type, like `T(int source)`
+         * @param N number of sources
+         * @param func generator function
+         * @notice the generator is called concurrently by different sources.
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                std::is_constructible<std::function<T(int)>, FUNC>::value>::type>
+        Tap(size_t N, FUNC func)
+                : m_state(new State) {
+            if (N == 0) throw Exception("Tap needs at least one source.");
+            std::function<T(int)> generator(func);
+            for (size_t i = 0; i < N; ++i) {
+                auto source = int(i);
+                m_state->sources.emplace_back(Generator([generator, source]() { return generator(source); }));
+            }
+        }
 
         /**
          * give initializer_list to generate
@@ -1012,43 +1820,170 @@ namespace ohm {
                 : self(make_generator(beg, end)) {}
 
         /**
-         * generate one data to queue.
+         * Release each data `1 / rate` second after the previous one of the same source.
+         * Release time is scheduled from start of source, so sleeping error does not drift the rate.
+         * @param rate data per second of each source, 0 means not pacing
+         * @return self
+         */
+        self &pace(double rate) {
+            m_state->rate = rate;
+            m_state->timestamp = nullptr;
+            return *this;
+        }
+
+        /**
+         * Release each data at its recorded time, used to replay recorded data at original rate.
+         * Timestamps of all sources share one time base, the first data released immediately.
+         * @tparam FUNC timestamp function type
+         * @param timestamp take `const T &`, return recorded time of data
+         * @param speed replay speed, 2 means twice as fast as recorded.
+         * @return self
+         */
+        template<typename FUNC, typename=typename std::enable_if<
+                std::is_constructible<Timestamp, FUNC>::value>::type>
+        self &pace(FUNC timestamp, double speed = 1) {
+            if (speed <= 0) throw Exception("Tap pace speed must be positive.");
+            m_state->rate = 0;
+            m_state->timestamp = timestamp;
+            m_state->speed = speed;
+            return *this;
+        }
+
+        /**
+         * @return number of sources
+         */
+        size_t sources() const {
+            return m_state->sources.size();
+        }
+
+        /**
+         * generate one data to queue, sources take turns.
          * if would throw PipeBreak exception if no data could be generated.
          */
         void generate() {
-            this->push(m_generator());
+            auto &sources = m_state->sources;
+            generate(sources.size() == 1 ? 0 : m_state->turn++ % sources.size());
+        }
+
+        /**
+         * generate one data of `source` to queue, wait until release time if pacing.
+         * if would throw PipeBreak exception if no data could be generated.
+         * @param source source index
+         * @notice do not generate same source in different threads at the same time.
+         */
+        void generate(size_t source) {
+            auto &current = m_state->sources[source];
+            auto data = current.generator();
+            if (m_state->rate > 0 || m_state->timestamp) release(current, data);
+            this->push(std::move(data));
         }
 
         /**
          * loop call `generate` until catch `PipeBreak`
+         * With several sources, each source loops in its own thread, the first source in this thread.
          */
         void loop() {
-            try {
+            loop_sources([this](size_t source) {
                 while (true) {
-                    generate();
+                    generate(source);
                 }
-            } catch (const PipeBreak &) {
-                return;
-            }
+            });
         }
 
         /**
          * loop call `generate` `times` times until catch `PipeBreak`
+         * With several sources, each source generates `times` times in its own thread.
          * @param times loop times
          */
         template<typename I, typename=Required<std::is_integral<I>>>
         void loop(I times) {
-            try {
+            loop_sources([this, times](size_t source) {
                 for (I i = 0; i < times; ++i) {
-                    generate();
+                    generate(source);
                 }
-            } catch (const PipeBreak &) {
-                return;
-            }
+            });
         }
 
     private:
-        Generator m_generator;
+        using clock = std::chrono::steady_clock;
+
+        struct Source {
+            Generator generator;
+            bool started = false;
+            clock::time_point start;    ///< release time of first data
+            int64_t count = 0;          ///< data released since start
+
+            explicit Source(Generator generator) : generator(std::move(generator)) {}
+        };
+
+        /**
+         * Shared by copies of tap.
+         */
+        struct State {
+            std::deque<Source> sources;
+            std::atomic<size_t> turn{0};   ///< next source of `generate()`
+
+            double rate = 0;
+            Timestamp timestamp;
+            double speed = 1;
+
+            std::mutex base_mutex;
+            bool base_set = false;          ///< time base of timestamps set by first data
+            time::us base_stamp{0};
+            clock::time_point base_time;
+        };
+
+        /**
+         * Run `func(source)` for each source until PipeBreak, rethrow the first other exception after all stopped.
+         */
+        void loop_sources(const std::function<void(size_t)> &func) {
+            std::mutex mutex;
+            std::exception_ptr error;
+            auto run = [&](size_t source) {
+                try {
+                    func(source);
+                } catch (const PipeBreak &) {
+                } catch (...) {
+                    std::unique_lock<std::mutex> _lock(mutex);
+                    if (!error) error = std::current_exception();
+                }
+            };
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < m_state->sources.size(); ++i) threads.emplace_back(run, i);
+            run(0);
+            for (auto &thread : threads) thread.join();
+            if (error) std::rethrow_exception(error);
+        }
+
+        void release(Source &source, const T &data) {
+            auto &state = *m_state;
+            auto now = clock::now();
+            clock::time_point time;
+            if (state.timestamp) {
+                auto stamp = state.timestamp(data);
+                {
+                    std::unique_lock<std::mutex> _lock(state.base_mutex);
+                    if (!state.base_set) {
+                        state.base_set = true;
+                        state.base_stamp = stamp;
+                        state.base_time = now;
+                    }
+                }
+                auto offset = std::chrono::duration<double, std::micro>(stamp - state.base_stamp) / state.speed;
+                time = state.base_time + std::chrono::duration_cast<clock::duration>(offset);
+            } else {
+                if (!source.started) {
+                    source.started = true;
+                    source.start = now;
+                    source.count = 0;
+                }
+                auto offset = std::chrono::duration<double>(double(source.count++) / state.rate);
+                time = source.start + std::chrono::duration_cast<clock::duration>(offset);
+            }
+            if (time > now) std::this_thread::sleep_until(time);
+        }
+
+        std::shared_ptr<State> m_state;
     };
 }
 
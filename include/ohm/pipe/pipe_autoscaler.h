@@ -0,0 +1,180 @@
+//
+// Created by kier on 2020/12/11.
+//
+
+#ifndef OMEGA_PIPE_AUTOSCALER_H
+#define OMEGA_PIPE_AUTOSCALER_H
+
+#include "pipe_profiler.h"
+#include "../thread/loop_thread.h"
+#include "../logger.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace ohm {
+    /**
+     * Grow or shrink number of threads of profiled pipes, to keep each queue's backlog near target.
+     * Grows in proportion to backlog over target, at most doubles each tick, shrinks one thread at a time.
+     * Only read metrics in PipeProfiler and resize by PipeProfiler, so no change of stage code.
+     * Every decision is recorded as event of PipeProfiler::Report.
+     */
+    class PipeAutoscaler {
+    public:
+        using self = PipeAutoscaler;
+
+        struct Bound {
+            int64_t min;        ///< min number of threads
+            int64_t max;        ///< max number of threads
+            int64_t target;     ///< wanted backlog of queue, 0 means half of limit, or number of threads if no limit
+        };
+
+        /**
+         * @param profiler profiler of pipes, got by `Pipe::profiler()`
+         * @param interval time between two decisions
+         * @note only stages set by `stage` or `stages` are scaled, call `start` after setting.
+         */
+        explicit PipeAutoscaler(std::shared_ptr<PipeProfiler> profiler, time::ms interval = time::ms(1000))
+                : m_profiler(std::move(profiler)), m_interval(interval), m_has_default(false)
+                , m_verbose(false) {
+        }
+
+        ~PipeAutoscaler() {
+            stop();
+        }
+
+        PipeAutoscaler(const PipeAutoscaler &) = delete;
+
+        PipeAutoscaler &operator=(const PipeAutoscaler &) = delete;
+
+        /**
+         * Scale stage of profile name `name`.
+         * @param name profile name
+         * @param min min number of threads, at least 1
+         * @param max max number of threads
+         * @param target wanted backlog
+         * @return self
+         */
+        self &stage(const std::string &name, int64_t min, int64_t max, int64_t target = 0) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            m_bounds[name] = make_bound(min, max, target);
+            return *this;
+        }
+
+        /**
+         * Scale all profiled stages not set by `stage`.
+         * @return self
+         */
+        self &stages(int64_t min, int64_t max, int64_t target = 0) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            m_default = make_bound(min, max, target);
+            m_has_default = true;
+            return *this;
+        }
+
+        /**
+         * Also print decisions by `ohm_log`.
+         * @return self
+         */
+        self &verbose(bool on) {
+            m_verbose = on;
+            return *this;
+        }
+
+        /**
+         * Start deciding periodically in background.
+         */
+        void start() {
+            if (m_loop) return;
+            auto fps = 1000.0f / float(std::max<int64_t>(m_interval.count(), 1));
+            m_loop.reset(new LoopThread(LoopThread::FPS(fps), [this]() { tick(); }));
+        }
+
+        void stop() {
+            m_loop.reset();
+        }
+
+        /**
+         * Make one decision for each stage now.
+         */
+        void tick() {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            auto report = m_profiler->report();
+            for (auto &name : report.lines) {
+                auto &line = report.report[name];
+                const Bound *bound = nullptr;
+                auto it = m_bounds.find(name);
+                if (it != m_bounds.end()) {
+                    bound = &it->second;
+                } else if (m_has_default) {
+                    bound = &m_default;
+                }
+                if (!bound || line.threads <= 0) continue;
+                decide(name, line, *bound);
+            }
+        }
+
+    private:
+        std::shared_ptr<PipeProfiler> m_profiler;
+        time::ms m_interval;
+
+        std::mutex m_mutex;
+        std::map<std::string, Bound> m_bounds;
+        Bound m_default;
+        bool m_has_default;
+        std::map<std::string, int> m_idle_ticks;    ///< continuous ticks with nearly empty queue
+
+        bool m_verbose;
+        std::unique_ptr<LoopThread> m_loop;
+
+        static Bound make_bound(int64_t min, int64_t max, int64_t target) {
+            if (min < 1) min = 1;
+            if (max < min) max = min;
+            return {min, max, target};
+        }
+
+        void decide(const std::string &name, const PipeProfiler::Report::Line &line, const Bound &bound) {
+            static const int shrink_ticks = 3;
+            auto threads = line.threads;
+            auto backlog = line.queue.count;
+            auto target = bound.target;
+            if (target <= 0) target = line.capacity > 0 ? std::max<int64_t>(line.capacity / 2, 1) : threads;
+
+            auto wanted = threads;
+            std::string reason;
+            if (threads < bound.min) {
+                wanted = bound.min;
+                reason = "below min";
+            } else if (threads > bound.max) {
+                wanted = bound.max;
+                reason = "above max";
+            } else if (backlog > target) {
+                m_idle_ticks[name] = 0;
+                // grow threads in proportion to backlog over target, at most double each time,
+                //     so a full queue of default target doubles threads each tick
+                auto step = (threads * backlog + target - 1) / target - threads;
+                step = std::min(std::max<int64_t>(step, 1), threads);
+                wanted = std::min(threads + step, bound.max);
+                reason = sprint("backlog ", backlog, " > target ", target);
+            } else if (backlog * 4 <= target) {
+                // shrink slowly, only after queue keeps nearly empty
+                if (++m_idle_ticks[name] >= shrink_ticks) {
+                    m_idle_ticks[name] = 0;
+                    wanted = std::max(threads - 1, bound.min);
+                    reason = sprint("backlog ", backlog, " <= target / 4 for ", shrink_ticks, " ticks");
+                }
+            } else {
+                m_idle_ticks[name] = 0;
+            }
+            if (wanted == threads) return;
+            if (!m_profiler->resize(name, wanted)) return;
+
+            auto message = sprint("threads ", threads, " -> ", wanted, ", ", reason);
+            m_profiler->event(name, message);
+            if (m_verbose) ohm_log(LOG_INFO, "[PipeAutoscaler] ", name, ": ", message);
+        }
+    };
+}
+
+#endif //OMEGA_PIPE_AUTOSCALER_H
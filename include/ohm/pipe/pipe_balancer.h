@@ -0,0 +1,186 @@
+//
+// Created by kier on 2020/12/21.
+//
+
+#ifndef OMEGA_PIPE_BALANCER_H
+#define OMEGA_PIPE_BALANCER_H
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "../except.h"
+
+namespace ohm {
+    /**
+     * How `Pipe::dispatch` spreads values over cases doing same work, like replicas of one model.
+     * Usage:
+     * ```
+     * // replica 1 is twice faster than replica 0
+     * auto replicas = pipe.dispatch(3, ohm::PipeBalancing::LeastQueued({1, 2, 1}));
+     * ```
+     */
+    struct PipeBalancing {
+        enum Mode {
+            ROUND_ROBIN,    // each case in turn
+            LEAST_QUEUED,   // case with least values waiting, scanning all cases
+            TWO_CHOICES,    // less loaded of two random cases, nearly as even as least queued with two reads
+            WEIGHTED,       // each case in turn, cases with more weight more often, spread evenly
+        };
+
+        Mode mode = ROUND_ROBIN;
+        std::vector<int64_t> weights;   ///< relative speed of each case, empty means equal
+
+        static PipeBalancing RoundRobin() {
+            return PipeBalancing();
+        }
+
+        /**
+         * @param weights queue length is compared in unit of weight, so faster case gets longer queue
+         */
+        static PipeBalancing LeastQueued(std::vector<int64_t> weights = {}) {
+            PipeBalancing balancing;
+            balancing.mode = LEAST_QUEUED;
+            balancing.weights = std::move(weights);
+            return balancing;
+        }
+
+        /**
+         * @param weights queue length is compared in unit of weight, so faster case gets longer queue
+         */
+        static PipeBalancing TwoChoices(std::vector<int64_t> weights = {}) {
+            PipeBalancing balancing;
+            balancing.mode = TWO_CHOICES;
+            balancing.weights = std::move(weights);
+            return balancing;
+        }
+
+        /**
+         * @param weights share of values of each case, like {1, 2} sends twice values to case 1
+         */
+        static PipeBalancing Weighted(std::vector<int64_t> weights) {
+            PipeBalancing balancing;
+            balancing.mode = WEIGHTED;
+            balancing.weights = std::move(weights);
+            return balancing;
+        }
+    };
+
+    /**
+     * Pick case for each value by `PipeBalancing`, called by dispatching threads concurrently.
+     * Load-aware modes read queue length of cases, which is live but may change at once.
+     * Weighted mode picks under a mutex, which is only held for a pass over weights.
+     */
+    class PipeBalancer {
+    public:
+        using self = PipeBalancer;
+
+        PipeBalancer(const PipeBalancer &) = delete;
+
+        PipeBalancer &operator=(const PipeBalancer &) = delete;
+
+        PipeBalancer(size_t size, const PipeBalancing &balancing)
+                : m_mode(balancing.mode), m_size(size), m_turn(0) {
+            if (size == 0) throw Exception("Balancing needs at least one case.");
+            if (balancing.weights.empty()) {
+                m_weights.assign(size, 1);
+            } else {
+                if (balancing.weights.size() != size) {
+                    throw Exception("Balancing needs one weight for each case, got " +
+                                    std::to_string(balancing.weights.size()) + " weights for " +
+                                    std::to_string(size) + " cases.");
+                }
+                for (auto weight : balancing.weights) {
+                    if (weight <= 0) throw Exception("Balancing weights must be positive.");
+                }
+                m_weights = balancing.weights;
+            }
+            for (auto weight : m_weights) m_total += weight;
+            m_current.assign(size, 0);
+        }
+
+        /**
+         * @tparam FUNC take case index `size_t`, return values waiting in case `int64_t`
+         * @param length queue length of case, only called in load-aware modes
+         * @return case index
+         */
+        template<typename FUNC>
+        size_t pick(FUNC length) {
+            if (m_size == 1) return 0;
+            switch (m_mode) {
+                default:
+                    return m_turn.fetch_add(1, std::memory_order_relaxed) % m_size;
+                case PipeBalancing::WEIGHTED:
+                    return weighted();
+                case PipeBalancing::LEAST_QUEUED: {
+                    // start from next case in turn, so cases with same length are picked in turn
+                    auto start = m_turn.fetch_add(1, std::memory_order_relaxed) % m_size;
+                    auto best = start;
+                    auto best_length = length(start);
+                    for (size_t n = 1; n < m_size; ++n) {
+                        auto i = (start + n) % m_size;
+                        auto i_length = length(i);
+                        if (less(i, i_length, best, best_length)) {
+                            best = i;
+                            best_length = i_length;
+                        }
+                    }
+                    return best;
+                }
+                case PipeBalancing::TWO_CHOICES: {
+                    auto &random = Random();
+                    auto a = size_t(random() % m_size);
+                    auto b = size_t(random() % (m_size - 1));
+                    if (b >= a) ++b;
+                    auto a_length = length(a);
+                    auto b_length = length(b);
+                    return less(b, b_length, a, a_length) ? b : a;
+                }
+            }
+        }
+
+    private:
+        PipeBalancing::Mode m_mode;
+        size_t m_size;
+        std::vector<int64_t> m_weights;
+        std::atomic<size_t> m_turn;
+
+        std::mutex m_mutex;                 ///< guards `m_current` of weighted mode
+        std::vector<int64_t> m_current;
+        int64_t m_total = 0;
+
+        /**
+         * @return if case `i` is less loaded than case `j`, comparing (length + 1) / weight
+         */
+        bool less(size_t i, int64_t i_length, size_t j, int64_t j_length) const {
+            return (i_length + 1) * m_weights[j] < (j_length + 1) * m_weights[i];
+        }
+
+        /**
+         * Smooth weighted round robin, so cases with more weight are not picked in a row.
+         * Picked on the fly, any weights cost same time and memory.
+         */
+        size_t weighted() {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            size_t pick = 0;
+            for (size_t i = 0; i < m_size; ++i) {
+                m_current[i] += m_weights[i];
+                if (m_current[i] > m_current[pick]) pick = i;
+            }
+            m_current[pick] -= m_total;
+            return pick;
+        }
+
+        static std::minstd_rand &Random() {
+            static thread_local std::minstd_rand random{std::random_device()()};
+            return random;
+        }
+    };
+}
+
+#endif //OMEGA_PIPE_BALANCER_H
@@ -0,0 +1,483 @@
+//
+// Created by kier on 2020/12/18.
+//
+
+#ifndef OMEGA_PIPE_BUFFER_H
+#define OMEGA_PIPE_BUFFER_H
+
+#include "../except.h"
+#include "../platform.h"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+
+#if OHM_PLATFORM_OS_WINDOWS
+#include <malloc.h>
+#endif
+
+#if OHM_PLATFORM_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+namespace ohm {
+    class PipeBufferPool;
+
+    /**
+     * Memory block recycled by `PipeBufferPool`, only used by `PipeBuffer` and pool.
+     */
+    struct PipeBufferBlock {
+        std::atomic<int> refs;
+        uint8_t *data = nullptr;
+        size_t size = 0;            ///< requested size
+        size_t capacity = 0;        ///< usable size, size of class
+        size_t mapped = 0;          ///< length of mapped pages, 0 if allocated from heap
+        int klass = -1;             ///< size class, -1 if not recycled
+        std::shared_ptr<void> core; ///< keep pool alive while block in use
+
+        PipeBufferBlock() : refs(0) {}
+    };
+
+    /**
+     * Reference counted byte buffer from `PipeBufferPool`.
+     * Copying shares the same bytes, memory goes back to pool when last copy released, in any thread.
+     * Usage:
+     * ```
+     * ohm::PipeBufferPool pool;
+     * struct Frame { int index; ohm::PipeBuffer pixels; };
+     * ohm::Tap<Frame> input([&]() {
+     *     Frame frame{next++, pool.acquire(1920 * 1080 * 3)};
+     *     decode(frame.pixels.data(), frame.pixels.size());
+     *     return frame;
+     * });
+     * ```
+     */
+    class PipeBuffer {
+    public:
+        using self = PipeBuffer;
+
+        PipeBuffer() = default;
+
+        PipeBuffer(const PipeBuffer &that) : m_block(that.m_block) {
+            if (m_block) m_block->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        PipeBuffer(PipeBuffer &&that) : m_block(that.m_block) {
+            that.m_block = nullptr;
+        }
+
+        PipeBuffer &operator=(PipeBuffer that) {
+            std::swap(m_block, that.m_block);
+            return *this;
+        }
+
+        ~PipeBuffer() {
+            reset();
+        }
+
+        explicit operator bool() const { return m_block != nullptr; }
+
+        uint8_t *data() { return m_block ? m_block->data : nullptr; }
+
+        const uint8_t *data() const { return m_block ? m_block->data : nullptr; }
+
+        /**
+         * @return bytes requested, may be changed by `resize`
+         */
+        size_t size() const { return m_block ? m_block->size : 0; }
+
+        /**
+         * @return bytes usable, size of pool's size class
+         */
+        size_t capacity() const { return m_block ? m_block->capacity : 0; }
+
+        /**
+         * Change size in capacity, bytes kept.
+         * @param size new size
+         */
+        void resize(size_t size) {
+            if (!m_block) {
+                if (size == 0) return;
+                throw Exception("Can not resize empty PipeBuffer.");
+            }
+            if (size > capacity()) throw Exception("Can not resize PipeBuffer over capacity.");
+            m_block->size = size;
+        }
+
+        /**
+         * @return number of buffers sharing same bytes, 0 if empty
+         */
+        int use_count() const {
+            return m_block ? m_block->refs.load() : 0;
+        }
+
+        /**
+         * Release bytes, back to pool if it's the last copy.
+         */
+        inline void reset();
+
+    private:
+        friend class PipeBufferPool;
+
+        explicit PipeBuffer(PipeBufferBlock *block) : m_block(block) {}
+
+        PipeBufferBlock *m_block = nullptr;
+    };
+
+    /**
+     * Pool of byte buffers, for large payloads like decoded frames, created and freed at high rate.
+     * Sizes are rounded up to size classes, 4 classes between powers of two.
+     * Released buffers first go to cache of releasing thread, then to the shared cache, then freed.
+     * On Linux, classes not smaller than huge page size are mapped and advised to use transparent huge pages.
+     * Copies of pool share the same buffers.
+     */
+    class PipeBufferPool {
+    public:
+        using self = PipeBufferPool;
+
+        struct Stats {
+            int64_t hits = 0;       ///< acquires served from cache
+            int64_t misses = 0;     ///< acquires allocating new memory
+            int64_t used = 0;       ///< bytes of buffers in use
+            int64_t cached = 0;     ///< bytes of buffers cached for reusing
+            int64_t huge = 0;       ///< number of blocks on huge pages, in use or cached
+        };
+
+        /**
+         * @param max_cached max bytes of cached buffers
+         * @param max_size max buffer size recycled, larger buffers are freed when released.
+         */
+        explicit PipeBufferPool(size_t max_cached = size_t(256) << 20, size_t max_size = size_t(64) << 20)
+                : m_core(std::make_shared<Core>(max_cached, max_size)) {}
+
+        /**
+         * Set max bytes each thread caches for this pool, cached buffers are reused without locking.
+         * @param bytes 0 means no thread cache
+         * @return self
+         */
+        self &local(size_t bytes) {
+            m_core->local = bytes;
+            return *this;
+        }
+
+        /**
+         * Set size from which blocks are placed on huge pages.
+         * @param bytes 0 means never
+         * @return self
+         * @notice only affects blocks allocated after.
+         */
+        self &huge(size_t bytes) {
+            m_core->huge = bytes;
+            return *this;
+        }
+
+        /**
+         * @param size bytes wanted
+         * @return buffer of `size` bytes, content not initialized.
+         */
+        PipeBuffer acquire(size_t size) {
+            auto &core = *m_core;
+            auto klass = core.klass(size);
+            PipeBufferBlock *block = klass >= 0 ? take(m_core, klass) : nullptr;
+            if (!block) {
+                block = allocate(klass >= 0 ? core.classes[klass] : size, klass, core.huge);
+                core.misses.fetch_add(1, std::memory_order_relaxed);
+                if (block->mapped) ++core.mapped;
+            }
+            block->refs = 1;
+            block->size = size;
+            block->core = m_core;
+            core.used += int64_t(block->capacity);
+            return PipeBuffer(block);
+        }
+
+        Stats stats() const {
+            auto &core = *m_core;
+            Stats stats;
+            stats.hits = core.hits.load();
+            stats.misses = core.misses.load();
+            stats.used = core.used.load();
+            stats.cached = core.cached.load();
+            stats.huge = core.mapped.load();
+            return stats;
+        }
+
+        /**
+         * Free shared cache and cache of calling thread.
+         * Caches of other threads are kept until the threads exit.
+         */
+        void trim() {
+            auto &core = *m_core;
+            auto entry = Local().find(m_core, false);
+            if (entry) Local().flush(*entry, m_core);
+            std::vector<PipeBufferBlock *> blocks;
+            {
+                std::unique_lock<std::mutex> _lock(core.mutex);
+                for (auto &list : core.central) {
+                    blocks.insert(blocks.end(), list.begin(), list.end());
+                    list.clear();
+                }
+            }
+            for (auto block : blocks) {
+                core.cached -= int64_t(block->capacity);
+                core.destroy(block);
+            }
+        }
+
+    private:
+        friend class PipeBuffer;
+
+        static const size_t LOCAL_BLOCKS = 4;   ///< max blocks of each class cached in one thread
+
+        struct Core {
+            uint64_t id;
+            std::vector<size_t> classes;
+            size_t max_cached;
+            std::atomic<size_t> local;
+            std::atomic<size_t> huge;
+
+            std::mutex mutex;
+            std::vector<std::vector<PipeBufferBlock *>> central;
+
+            std::atomic<int64_t> hits;
+            std::atomic<int64_t> misses;
+            std::atomic<int64_t> used;
+            std::atomic<int64_t> cached;
+            std::atomic<int64_t> mapped;
+
+            Core(size_t max_cached, size_t max_size)
+                    : id(NextID()), max_cached(max_cached), local(size_t(16) << 20), huge(HugePage)
+                    , hits(0), misses(0), used(0), cached(0), mapped(0) {
+                for (size_t base = 4096; base < max_size; base *= 2) {
+                    for (size_t step = 0; step < 4; ++step) {
+                        auto size = base + base / 4 * step;
+                        // huge page classes are whole pages, or last page half wasted
+                        if (size > HugePage) size = (size + HugePage - 1) / HugePage * HugePage;
+                        if (!classes.empty() && classes.back() >= size) continue;
+                        if (size > max_size) break;
+                        classes.push_back(size);
+                    }
+                }
+                if (classes.empty() || classes.back() < max_size) classes.push_back(max_size);
+                central.resize(classes.size());
+            }
+
+            ~Core() {
+                for (auto &list : central) {
+                    for (auto block : list) destroy(block);
+                }
+            }
+
+            int klass(size_t size) const {
+                auto it = std::lower_bound(classes.begin(), classes.end(), size);
+                if (it == classes.end()) return -1;
+                return int(it - classes.begin());
+            }
+
+            void put(PipeBufferBlock *block) {
+                auto capacity = int64_t(block->capacity);
+                {
+                    std::unique_lock<std::mutex> _lock(mutex);
+                    if (cached.load() + capacity <= int64_t(max_cached)) {
+                        central[block->klass].push_back(block);
+                        cached += capacity;
+                        return;
+                    }
+                }
+                destroy(block);
+            }
+
+            void destroy(PipeBufferBlock *block) {
+                if (block->mapped) --mapped;
+                deallocate(block);
+            }
+        };
+
+        /**
+         * Blocks cached in one thread, for each living pool used in the thread.
+         */
+        struct LocalCache {
+            struct Entry {
+                uint64_t id;
+                std::weak_ptr<Core> core;
+                std::vector<std::vector<PipeBufferBlock *>> blocks;
+                size_t bytes = 0;
+            };
+
+            std::vector<Entry> entries;
+
+            ~LocalCache() {
+                Down() = true;
+                for (auto &entry : entries) flush(entry, entry.core.lock());
+            }
+
+            /**
+             * @param create create entry if not found
+             * @return nullptr if not found, or thread exiting.
+             */
+            Entry *find(const std::shared_ptr<Core> &core, bool create) {
+                if (Down()) return nullptr;
+                for (auto &entry : entries) {
+                    if (entry.id == core->id) return &entry;
+                }
+                if (!create) return nullptr;
+                // entries of destroyed pools are cleaned when new pool used
+                for (auto &entry : entries) {
+                    if (entry.core.expired()) flush(entry, nullptr);
+                }
+                entries.erase(std::remove_if(entries.begin(), entries.end(), [](const Entry &entry) {
+                    return entry.core.expired();
+                }), entries.end());
+                Entry entry;
+                entry.id = core->id;
+                entry.core = core;
+                entry.blocks.resize(core->classes.size());
+                entries.push_back(std::move(entry));
+                return &entries.back();
+            }
+
+            void flush(Entry &entry, const std::shared_ptr<Core> &core) {
+                for (auto &list : entry.blocks) {
+                    for (auto block : list) {
+                        if (core) {
+                            core->cached -= int64_t(block->capacity);
+                            core->put(block);
+                        } else {
+                            deallocate(block);
+                        }
+                    }
+                    list.clear();
+                }
+                entry.bytes = 0;
+            }
+        };
+
+        static LocalCache &Local() {
+            static thread_local LocalCache cache;
+            return cache;
+        }
+
+        /**
+         * @return if thread cache destroyed, it's trivially destructible so readable after thread cache gone.
+         */
+        static bool &Down() {
+            static thread_local bool down = false;
+            return down;
+        }
+
+        static uint64_t NextID() {
+            static std::atomic<uint64_t> next(0);
+            return ++next;
+        }
+
+        static const size_t HugePage = size_t(2) << 20;
+
+        static PipeBufferBlock *allocate(size_t capacity, int klass, size_t huge) {
+            std::unique_ptr<PipeBufferBlock> block(new PipeBufferBlock);
+            block->capacity = capacity;
+            block->klass = klass;
+#if OHM_PLATFORM_OS_LINUX
+            if (huge > 0 && capacity >= huge) {
+                auto length = (capacity + HugePage - 1) / HugePage * HugePage;
+                auto pages = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (pages != MAP_FAILED) {
+#if defined(MADV_HUGEPAGE)
+                    madvise(pages, length, MADV_HUGEPAGE);
+#endif
+                    block->data = reinterpret_cast<uint8_t *>(pages);
+                    block->mapped = length;
+                }
+            }
+#else
+            (void) huge;
+#endif
+            if (!block->data) {
+                void *memory = nullptr;
+                // cache line aligned, for SIMD loads
+#if OHM_PLATFORM_OS_WINDOWS
+                memory = _aligned_malloc(capacity ? capacity : 1, 64);
+#else
+                if (posix_memalign(&memory, 64, capacity ? capacity : 1) != 0) memory = nullptr;
+#endif
+                if (!memory) throw std::bad_alloc();
+                block->data = reinterpret_cast<uint8_t *>(memory);
+            }
+            return block.release();
+        }
+
+        static void deallocate(PipeBufferBlock *block) {
+            if (block->mapped) {
+#if OHM_PLATFORM_OS_LINUX
+                munmap(block->data, block->mapped);
+#endif
+            } else {
+#if OHM_PLATFORM_OS_WINDOWS
+                _aligned_free(block->data);
+#else
+                std::free(block->data);
+#endif
+            }
+            delete block;
+        }
+
+        static PipeBufferBlock *take(const std::shared_ptr<Core> &core, int klass) {
+            auto entry = core->local.load() > 0 ? Local().find(core, true) : nullptr;
+            if (entry && !entry->blocks[klass].empty()) {
+                auto block = entry->blocks[klass].back();
+                entry->blocks[klass].pop_back();
+                entry->bytes -= block->capacity;
+                core->cached -= int64_t(block->capacity);
+                core->hits.fetch_add(1, std::memory_order_relaxed);
+                return block;
+            }
+            std::unique_lock<std::mutex> _lock(core->mutex);
+            auto &list = core->central[klass];
+            if (list.empty()) return nullptr;
+            auto block = list.back();
+            list.pop_back();
+            core->cached -= int64_t(block->capacity);
+            core->hits.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+
+        /**
+         * Called when last buffer of block released.
+         */
+        static void release(PipeBufferBlock *block) {
+            auto core = std::static_pointer_cast<Core>(block->core);
+            block->core.reset();
+            auto capacity = block->capacity;
+            core->used -= int64_t(capacity);
+            if (block->klass < 0) {
+                core->destroy(block);
+                return;
+            }
+            auto entry = core->local.load() > 0 ? Local().find(core, true) : nullptr;
+            if (entry && entry->bytes + capacity <= core->local.load()
+                && entry->blocks[block->klass].size() < LOCAL_BLOCKS) {
+                entry->blocks[block->klass].push_back(block);
+                entry->bytes += capacity;
+                core->cached += int64_t(capacity);
+                return;
+            }
+            core->put(block);
+        }
+
+        std::shared_ptr<Core> m_core;
+    };
+
+    inline void PipeBuffer::reset() {
+        if (!m_block) return;
+        if (m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            PipeBufferPool::release(m_block);
+        }
+        m_block = nullptr;
+    }
+}
+
+#endif //OMEGA_PIPE_BUFFER_H
@@ -0,0 +1,440 @@
+//
+// Created by kier on 2020/12/20.
+//
+
+#ifndef OMEGA_PIPE_EXPORTER_H
+#define OMEGA_PIPE_EXPORTER_H
+
+#include "pipe_profiler.h"
+#include "../socket.h"
+#include "../except.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <locale>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace ohm {
+    /**
+     * Render `PipeProfiler::Report` in OpenMetrics text format, which Prometheus scrapes.
+     * Each stage is labeled `stage="<profile name>"`, metric names do not change with graph.
+     * Usage:
+     * ```
+     * ohm::PipeExporter exporter(input.profiler());
+     * exporter.label("pipeline", "faces");
+     * exporter.serve(9100);                                // scraped on http://host:9100/metrics
+     * exporter.write("/var/lib/node_exporter/faces.prom", ohm::time::sec(15));     // or written to file
+     * ```
+     * Families, `<prefix>` is `ohm_pipe` by default:
+     *  <prefix>_queue_size, <prefix>_queue_capacity, <prefix>_threads: gauges
+     *  <prefix>_input_total, <prefix>_output_total: counters of values in and out of queue
+     *  <prefix>_input_rate, <prefix>_output_rate: gauges, values each second over the latest 2 seconds
+     *  <prefix>_input_idle_seconds, <prefix>_output_idle_seconds: gauges, time since last value
+     *  <prefix>_processing_average_seconds: gauge, average processing time over the latest 2 seconds
+     *  <prefix>_processing_seconds: histogram of processing time of sampled values
+     *  <prefix>_queue_wait_seconds, <prefix>_service_seconds, <prefix>_latency_seconds:
+     *      histograms of traced values, only stages with traced values
+     *  <prefix>_stage_metric: gauges of stage specific metrics, labeled `metric="<name>"`
+     */
+    class PipeExporter {
+    public:
+        using self = PipeExporter;
+        using Labels = std::vector<std::pair<std::string, std::string>>;
+        using Getter = std::function<PipeProfiler::Report()>;
+
+        PipeExporter(const PipeExporter &) = delete;
+
+        PipeExporter &operator=(const PipeExporter &) = delete;
+
+        explicit PipeExporter(std::shared_ptr<PipeProfiler> profiler)
+                : m_getter([profiler]() { return profiler->report(); }) {}
+
+        /**
+         * @param getter return report to export, called in exporting thread
+         */
+        explicit PipeExporter(Getter getter)
+                : m_getter(std::move(getter)) {}
+
+        ~PipeExporter() {
+            stop();
+        }
+
+        /**
+         * Set prefix of metric names, must be set before exporting.
+         */
+        PipeExporter &prefix(const std::string &prefix) {
+            m_prefix = prefix;
+            return *this;
+        }
+
+        /**
+         * Add label to every sample, like which pipeline in process, must be set before exporting.
+         */
+        PipeExporter &label(const std::string &name, const std::string &value) {
+            m_labels.emplace_back(name, value);
+            return *this;
+        }
+
+        /**
+         * @return current report in OpenMetrics text format
+         */
+        std::string text() const {
+            return Text(m_getter(), m_prefix, m_labels);
+        }
+
+        /**
+         * Write current report to file, replace the file at once, so readers never see part of it.
+         */
+        void write(const std::string &path) const {
+            auto tmp = path + ".tmp";
+            {
+                std::ofstream file(tmp, std::ios::binary);
+                if (!file.is_open()) throw Exception("Can not open file: " + tmp);
+                file << text();
+                if (!file) throw Exception("Can not write file: " + tmp);
+            }
+            if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+                // rename to existing file fails on Windows
+                std::remove(path.c_str());
+                if (std::rename(tmp.c_str(), path.c_str()) != 0) throw Exception("Can not write file: " + path);
+            }
+        }
+
+        /**
+         * Write report to file every `interval` in a new thread, until `stop`, which writes the last report.
+         * Failed writing is retried next interval.
+         */
+        void write(const std::string &path, time::ms interval) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (m_writer.joinable()) throw Exception("Exporter is already writing file.");
+            m_stopped = false;
+            m_writer = std::thread([this, path, interval]() {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                while (!m_stopped) {
+                    _lock.unlock();
+                    try {
+                        write(path);
+                    } catch (const std::exception &) {
+                        // ...
+                    }
+                    _lock.lock();
+                    m_cond.wait_for(_lock, interval, [this]() { return m_stopped; });
+                }
+                _lock.unlock();
+                // last report, so file shows the finished graph
+                try {
+                    write(path);
+                } catch (const std::exception &) {
+                    // ...
+                }
+            });
+        }
+
+        /**
+         * Serve report on HTTP in a new thread, until `stop`, every path answers with the report.
+         * @param port listening port
+         * @param ip listening address, IPv4 or IPv6
+         */
+        void serve(int port, const std::string &ip = "0.0.0.0") {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (m_server.joinable()) throw Exception("Exporter is already serving.");
+            m_listener = std::make_shared<Server>(Protocol::TCP, make_address(ip, port));
+            m_wake = ip == "0.0.0.0" ? "127.0.0.1" : ip == "::" ? "::1" : ip;
+            m_port = port;
+            m_serving = true;
+            auto listener = m_listener;
+            m_server = std::thread([this, listener]() {
+                while (m_serving) {
+                    try {
+                        auto connection = listener->accept();
+                        if (!m_serving) break;
+                        // silent client would block serving
+                        connection.timeout(1000);
+                        answer(connection);
+                    } catch (const std::exception &) {
+                        // ...
+                    }
+                }
+            });
+        }
+
+        /**
+         * Stop writing and serving, wait running exporting finished.
+         */
+        void stop() {
+            {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                m_stopped = true;
+                m_cond.notify_all();
+            }
+            if (m_writer.joinable()) m_writer.join();
+            if (m_server.joinable()) {
+                m_serving = false;
+                try {
+                    // wake blocked accept
+                    Client::Connect(Protocol::TCP, make_address(m_wake, m_port));
+                } catch (const std::exception &) {
+                    // ...
+                }
+                m_server.join();
+                m_listener->close();
+                m_listener.reset();
+            }
+        }
+
+        /**
+         * Render report in OpenMetrics text format.
+         * @param report report of profiler
+         * @param prefix prefix of metric names
+         * @param labels labels added to every sample
+         */
+        static std::string Text(const PipeProfiler::Report &report,
+                                const std::string &prefix = "ohm_pipe", const Labels &labels = {}) {
+            // names in order of profiled, and the others not in lines
+            std::vector<const PipeProfiler::Report::Line *> lines;
+            for (auto &name : report.lines) {
+                auto it = report.report.find(name);
+                if (it != report.report.end()) lines.push_back(&it->second);
+            }
+            for (auto &pair : report.report) {
+                if (std::find(report.lines.begin(), report.lines.end(), pair.first) != report.lines.end()) continue;
+                lines.push_back(&pair.second);
+            }
+
+            Writer out(prefix, labels);
+
+            out.family("queue_size", "gauge", "values waiting in queue");
+            for (auto line : lines) out.sample("queue_size", line->name, line->queue.count);
+
+            out.family("queue_capacity", "gauge", "size limit of queue, 0 if not limited");
+            for (auto line : lines) out.sample("queue_capacity", line->name, line->capacity);
+
+            out.family("threads", "gauge", "threads processing values of queue");
+            for (auto line : lines) out.sample("threads", line->name, line->threads);
+
+            out.family("input", "counter", "values pushed into queue");
+            for (auto line : lines) out.sample("input_total", line->name, line->queue.in.total);
+
+            out.family("output", "counter", "values popped out of queue");
+            for (auto line : lines) out.sample("output_total", line->name, line->queue.out.total);
+
+            out.family("input_rate", "gauge", "values pushed each second over the latest 2 seconds");
+            for (auto line : lines) out.sample("input_rate", line->name, double(line->queue.in.dps));
+
+            out.family("output_rate", "gauge", "values popped each second over the latest 2 seconds");
+            for (auto line : lines) out.sample("output_rate", line->name, double(line->queue.out.dps));
+
+            out.family("input_idle_seconds", "gauge", "time since last value pushed", "seconds");
+            for (auto line : lines) {
+                out.sample("input_idle_seconds", line->name, Seconds(line->queue.in.waited_time));
+            }
+
+            out.family("output_idle_seconds", "gauge", "time since last value popped", "seconds");
+            for (auto line : lines) {
+                out.sample("output_idle_seconds", line->name, Seconds(line->queue.out.waited_time));
+            }
+
+            out.family("processing_average_seconds", "gauge",
+                       "average processing time of each value over the latest 2 seconds", "seconds");
+            for (auto line : lines) {
+                out.sample("processing_average_seconds", line->name, Seconds(line->average_time));
+            }
+
+            out.family("processing_seconds", "histogram", "processing time of each sampled value", "seconds");
+            for (auto line : lines) out.histogram("processing_seconds", line->name, line->time);
+
+            struct Trace {
+                const char *name;
+                const char *help;
+                PipeHistogram::Summary PipeTraceWatcher::Report::*summary;
+            };
+            static const Trace Traces[] = {
+                    {"queue_wait_seconds", "time traced values waited in queue", &PipeTraceWatcher::Report::wait},
+                    {"service_seconds",    "time traced values processed",      &PipeTraceWatcher::Report::service},
+                    {"latency_seconds",    "time from origin to processed of traced values",
+                                                                                 &PipeTraceWatcher::Report::latency},
+            };
+            for (auto &trace : Traces) {
+                bool traced = false;
+                for (auto line : lines) traced = traced || (line->trace.*trace.summary).count > 0;
+                if (!traced) continue;
+                out.family(trace.name, "histogram", trace.help, "seconds");
+                for (auto line : lines) {
+                    auto &summary = line->trace.*trace.summary;
+                    if (summary.count > 0) out.histogram(trace.name, line->name, summary);
+                }
+            }
+
+            bool measured = false;
+            for (auto line : lines) measured = measured || !line->metrics.empty();
+            if (measured) {
+                out.family("stage_metric", "gauge", "stage specific metrics, like reorder occupancy or pool hits");
+                for (auto line : lines) {
+                    for (auto &metric : line->metrics) {
+                        out.sample("stage_metric", line->name, metric.second, {{"metric", metric.first}});
+                    }
+                }
+            }
+
+            out.eof();
+            return out.str();
+        }
+
+    private:
+        Getter m_getter;
+        std::string m_prefix = "ohm_pipe";
+        Labels m_labels;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        bool m_stopped = false;
+        std::thread m_writer;
+
+        std::atomic<bool> m_serving{false};
+        std::thread m_server;
+        std::shared_ptr<Server> m_listener;
+        std::string m_wake;     ///< address connected to wake server in stopping
+        int m_port = 0;
+
+        template<typename Rep, typename Period>
+        static double Seconds(const std::chrono::duration<Rep, Period> &duration) {
+            return std::chrono::duration_cast<std::chrono::duration<double>>(duration).count();
+        }
+
+        /**
+         * Read one HTTP request, and answer with current report.
+         */
+        void answer(Connection &connection) const {
+            std::string request;
+            char buffer[1024];
+            while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+                auto n = connection.recv(buffer, sizeof(buffer));
+                if (n <= 0) break;
+                request.append(buffer, size_t(n));
+            }
+            std::string status = "200 OK";
+            std::string body;
+            if (request.compare(0, 4, "GET ") != 0) {
+                status = "405 Method Not Allowed";
+            } else {
+                try {
+                    body = text();
+                } catch (const std::exception &e) {
+                    status = "500 Internal Server Error";
+                    body = std::string(e.what()) + "\n";
+                }
+            }
+            std::ostringstream oss;
+            oss << "HTTP/1.1 " << status << "\r\n"
+                << "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                << "Content-Length: " << body.size() << "\r\n"
+                << "Connection: close\r\n\r\n"
+                << body;
+            auto response = oss.str();
+            size_t sent = 0;
+            while (sent < response.size()) {
+                auto n = connection.send(response.data() + sent, int(response.size() - sent));
+                if (n <= 0) break;
+                sent += size_t(n);
+            }
+            connection.close();
+        }
+
+        /**
+         * Text writer, numbers are always written in classic locale.
+         */
+        class Writer {
+        public:
+            Writer(const std::string &prefix, const Labels &labels)
+                    : m_prefix(prefix), m_labels(labels) {
+                m_out.imbue(std::locale::classic());
+                m_out.precision(9);
+            }
+
+            void family(const std::string &name, const std::string &type,
+                        const std::string &help, const std::string &unit = "") {
+                m_out << "# TYPE " << m_prefix << "_" << name << " " << type << "\n";
+                if (!unit.empty()) m_out << "# UNIT " << m_prefix << "_" << name << " " << unit << "\n";
+                m_out << "# HELP " << m_prefix << "_" << name << " " << help << "\n";
+            }
+
+            template<typename T>
+            void sample(const std::string &name, const std::string &stage, T value, const Labels &extra = {}) {
+                m_out << m_prefix << "_" << name;
+                labels(stage, extra);
+                m_out << " " << value << "\n";
+            }
+
+            /**
+             * Write histogram of microseconds in seconds.
+             */
+            void histogram(const std::string &name, const std::string &stage, const PipeHistogram::Summary &summary) {
+                auto &bounds = PipeHistogram::Bounds();
+                for (size_t i = 0; i < bounds.size() && i < summary.buckets.size(); ++i) {
+                    m_out << m_prefix << "_" << name << "_bucket";
+                    labels(stage, {{"le", Decimal(bounds[i])}});
+                    m_out << " " << summary.buckets[i] << "\n";
+                }
+                m_out << m_prefix << "_" << name << "_bucket";
+                labels(stage, {{"le", "+Inf"}});
+                m_out << " " << summary.count << "\n";
+                m_out << m_prefix << "_" << name << "_count";
+                labels(stage);
+                m_out << " " << summary.count << "\n";
+                m_out << m_prefix << "_" << name << "_sum";
+                labels(stage);
+                m_out << " " << Decimal(summary.sum) << "\n";
+            }
+
+            void eof() {
+                m_out << "# EOF\n";
+            }
+
+            std::string str() const {
+                return m_out.str();
+            }
+
+        private:
+            std::string m_prefix;
+            const Labels &m_labels;
+            std::ostringstream m_out;
+
+            void labels(const std::string &stage, const Labels &extra = {}) {
+                m_out << "{stage=\"" << Escape(stage) << "\"";
+                for (auto &label : m_labels) m_out << "," << label.first << "=\"" << Escape(label.second) << "\"";
+                for (auto &label : extra) m_out << "," << label.first << "=\"" << Escape(label.second) << "\"";
+                m_out << "}";
+            }
+
+            static std::string Escape(const std::string &value) {
+                std::string escaped;
+                for (auto ch : value) {
+                    switch (ch) {
+                        case '\\': escaped += "\\\\"; break;
+                        case '"': escaped += "\\\""; break;
+                        case '\n': escaped += "\\n"; break;
+                        default: escaped += ch; break;
+                    }
+                }
+                return escaped;
+            }
+
+            /**
+             * @return microseconds in seconds, written exactly like "0.000005" or "10.0"
+             */
+            static std::string Decimal(int64_t us) {
+                auto fraction = std::to_string(1000000 + us % 1000000).substr(1);
+                while (fraction.size() > 1 && fraction.back() == '0') fraction.pop_back();
+                return std::to_string(us / 1000000) + "." + fraction;
+            }
+        };
+    };
+}
+
+#endif //OMEGA_PIPE_EXPORTER_H
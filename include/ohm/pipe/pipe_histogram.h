@@ -0,0 +1,179 @@
+//
+// Created by kier on 2020/12/15.
+//
+
+#ifndef OMEGA_PIPE_HISTOGRAM_H
+#define OMEGA_PIPE_HISTOGRAM_H
+
+#include "../thread/sharded_counter.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace ohm {
+    /**
+     * Lock-free log-linear histogram of non-negative values, like latency in microseconds.
+     * Values less than 16 are exact, others are grouped in 8 buckets between each power of 2,
+     * so percentiles are accurate within 12.5%.
+     * Recording is one relaxed add on the value's bucket and one on the sum's shard,
+     * count is summed from buckets when read.
+     */
+    class PipeHistogram {
+    public:
+        using self = PipeHistogram;
+
+        struct Summary {
+            int64_t count = 0;
+            int64_t sum = 0;        ///< sum of values
+            int64_t p50 = 0;
+            int64_t p90 = 0;
+            int64_t p99 = 0;
+            int64_t max = 0;
+            std::vector<int64_t> buckets;   ///< count of values not larger than each of `Bounds()`
+        };
+
+        PipeHistogram() {
+            reset();
+        }
+
+        PipeHistogram(const PipeHistogram &) = delete;
+
+        PipeHistogram &operator=(const PipeHistogram &) = delete;
+
+        void record(int64_t value) {
+            if (value < 0) value = 0;
+            m_buckets[index(value)].fetch_add(1, std::memory_order_relaxed);
+            m_sum.add(value);
+            auto max = m_max.load(std::memory_order_relaxed);
+            while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+        }
+
+        int64_t count() const {
+            int64_t count = 0;
+            for (auto &bucket : m_buckets) count += bucket.load(std::memory_order_relaxed);
+            return count;
+        }
+
+        int64_t sum() const {
+            return m_sum.load();
+        }
+
+        int64_t max() const {
+            return m_max.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @param p in [0, 1]
+         * @return upper bound of bucket containing the `p` quantile, not larger than max.
+         */
+        int64_t percentile(double p) const {
+            auto count = this->count();
+            if (count == 0) return 0;
+            auto rank = int64_t(p * double(count));
+            if (rank >= count) rank = count - 1;
+            int64_t seen = 0;
+            for (size_t i = 0; i < Size; ++i) {
+                seen += m_buckets[i].load(std::memory_order_relaxed);
+                if (seen > rank) {
+                    auto bound = upper(i);
+                    auto max = this->max();
+                    return bound < max ? bound : max;
+                }
+            }
+            return max();
+        }
+
+        /**
+         * Upper bounds of `Summary::buckets`, in 1-2-5 steps from 1 to 10^7, like 1us to 10s.
+         */
+        static const std::vector<int64_t> &Bounds() {
+            static const std::vector<int64_t> bounds = []() {
+                std::vector<int64_t> bounds;
+                for (int64_t base = 1; base <= 10000000; base *= 10) {
+                    bounds.push_back(base);
+                    if (base == 10000000) break;
+                    bounds.push_back(base * 2);
+                    bounds.push_back(base * 5);
+                }
+                return bounds;
+            }();
+            return bounds;
+        }
+
+        /**
+         * @return count of values not larger than each of `Bounds()`,
+         *         bucket crossing a bound is counted in next bound, so counts are low within 12.5% of bound.
+         */
+        std::vector<int64_t> buckets() const {
+            auto &bounds = Bounds();
+            std::vector<int64_t> result(bounds.size(), 0);
+            int64_t seen = 0;
+            size_t b = 0;
+            for (size_t i = 0; i < Size && b < bounds.size(); ++i) {
+                auto bound = upper(i);
+                while (b < bounds.size() && bounds[b] < bound) result[b++] = seen;
+                seen += m_buckets[i].load(std::memory_order_relaxed);
+            }
+            while (b < bounds.size()) result[b++] = seen;
+            return result;
+        }
+
+        Summary summary() const {
+            Summary summary;
+            summary.buckets = buckets();
+            summary.count = count();
+            summary.sum = sum();
+            // values recorded between reading buckets and count
+            if (summary.count < summary.buckets.back()) summary.count = summary.buckets.back();
+            summary.p50 = percentile(0.50);
+            summary.p90 = percentile(0.90);
+            summary.p99 = percentile(0.99);
+            summary.max = max();
+            return summary;
+        }
+
+        void reset() {
+            for (auto &bucket : m_buckets) bucket.store(0, std::memory_order_relaxed);
+            m_max.store(0, std::memory_order_relaxed);
+            m_sum.reset();
+        }
+
+    private:
+        static const int Linear = 16;       ///< values less than it are exact
+        static const int SubBits = 3;       ///< 8 buckets between each power of 2
+        static const size_t Size = Linear + (63 - 4 + 1) * (1 << SubBits);
+
+        std::atomic<int64_t> m_buckets[Size];
+        std::atomic<int64_t> m_max;
+        ShardedCounter m_sum;
+
+        static int log2(uint64_t value) {
+            int bits = 0;
+            while (value >>= 1) ++bits;
+            return bits;
+        }
+
+        static size_t index(int64_t value) {
+            if (value < Linear) return size_t(value);
+            auto exponent = log2(uint64_t(value));
+            auto sub = (uint64_t(value) >> (exponent - SubBits)) & ((1 << SubBits) - 1);
+            return size_t(Linear + (exponent - 4) * (1 << SubBits) + int(sub));
+        }
+
+        /**
+         * @return max value in bucket `i`
+         */
+        static int64_t upper(size_t i) {
+            if (i < size_t(Linear)) return int64_t(i);
+            auto exponent = int(i - Linear) / (1 << SubBits) + 4;
+            auto sub = int64_t(i - Linear) % (1 << SubBits);
+            auto base = int64_t(1) << exponent;
+            auto step = base >> SubBits;
+            return base + (sub + 1) * step - 1;
+        }
+    };
+}
+
+#endif //OMEGA_PIPE_HISTOGRAM_H
@@ -0,0 +1,204 @@
+//
+// Created by kier on 2020/12/17.
+//
+
+#ifndef OMEGA_PIPE_MAYBE_H
+#define OMEGA_PIPE_MAYBE_H
+
+#include "../except.h"
+#include "../type_iterable.h"
+
+#include <new>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+
+namespace ohm {
+    /**
+     * Value or nothing, returned by mapper to drop data without throwing `PipeLeak`,
+     * or by generator to tell end of data without throwing `PipeBreak`.
+     * Usage:
+     * ```
+     * pipe.map(4, [](Frame frame) -> PipeMaybe<Frame> {
+     *     if (!frame.valid) return {};
+     *     return frame;
+     * });
+     * ```
+     */
+    template<typename T>
+    class PipeMaybe {
+    public:
+        using self = PipeMaybe;
+        using Type = T;
+
+        PipeMaybe() : m_has(false) {}
+
+        PipeMaybe(T value) : m_has(true) {
+            new(&m_storage) T(std::move(value));
+        }
+
+        PipeMaybe(const PipeMaybe &that) : m_has(that.m_has) {
+            if (m_has) new(&m_storage) T(*that.pointer());
+        }
+
+        PipeMaybe(PipeMaybe &&that) : m_has(that.m_has) {
+            if (m_has) new(&m_storage) T(std::move(*that.pointer()));
+        }
+
+        PipeMaybe &operator=(PipeMaybe that) {
+            reset();
+            if (that.m_has) {
+                new(&m_storage) T(std::move(*that.pointer()));
+                m_has = true;
+            }
+            return *this;
+        }
+
+        ~PipeMaybe() {
+            reset();
+        }
+
+        bool has_value() const { return m_has; }
+
+        explicit operator bool() const { return m_has; }
+
+        T &value() {
+            if (!m_has) throw Exception("Can not get value of empty PipeMaybe.");
+            return *pointer();
+        }
+
+        const T &value() const {
+            if (!m_has) throw Exception("Can not get value of empty PipeMaybe.");
+            return *pointer();
+        }
+
+        /**
+         * @return moved value, must has value
+         */
+        T take() {
+            return std::move(value());
+        }
+
+        void reset() {
+            if (!m_has) return;
+            pointer()->~T();
+            m_has = false;
+        }
+
+    private:
+        T *pointer() { return reinterpret_cast<T *>(&m_storage); }
+
+        const T *pointer() const { return reinterpret_cast<const T *>(&m_storage); }
+
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type m_storage;
+        bool m_has;
+    };
+
+    template<typename T>
+    struct is_pipe_maybe : public std::false_type {
+    };
+
+    template<typename T>
+    struct is_pipe_maybe<PipeMaybe<T>> : public std::true_type {
+    };
+
+    /**
+     * Type of data pushed to next pipe, `T` of `PipeMaybe<T>`, or itself.
+     */
+    template<typename T>
+    struct pipe_unwrap {
+        using type = T;
+    };
+
+    template<typename T>
+    struct pipe_unwrap<PipeMaybe<T>> {
+        using type = T;
+    };
+
+    /**
+     * Generator moving out values of owned range, empty `PipeMaybe` means end.
+     * Unlike `make_generator`, it is a plain value, no shared state or `std::function`.
+     * @tparam Range range type, like vector or list
+     */
+    template<typename Range>
+    class PipeRangeGenerator {
+    public:
+        using self = PipeRangeGenerator;
+        using value_type = typename has_iterator<Range>::value_type;
+        using iterator = typename std::decay<decltype(std::declval<Range &>().begin())>::type;
+
+        explicit PipeRangeGenerator(Range range)
+                : m_range(std::move(range)), m_it(m_range.begin()) {}
+
+        // iterators point into the owned range, so they are rebuilt by offset on copy.
+        PipeRangeGenerator(const PipeRangeGenerator &that)
+                : self(that.m_range, that.offset()) {}
+
+        PipeRangeGenerator(PipeRangeGenerator &&that)
+                : self(std::move(that.m_range), that.offset()) {}
+
+        PipeRangeGenerator &operator=(const PipeRangeGenerator &) = delete;
+
+        PipeMaybe<value_type> operator()() {
+            if (m_it == m_range.end()) return {};
+            return PipeMaybe<value_type>(std::move(*m_it++));
+        }
+
+    private:
+        using difference_type = typename std::iterator_traits<iterator>::difference_type;
+
+        template<typename R>
+        PipeRangeGenerator(R &&range, difference_type offset)
+                : m_range(std::forward<R>(range)), m_it(m_range.begin()) {
+            std::advance(m_it, offset);
+        }
+
+        difference_type offset() const {
+            return std::distance(const_cast<Range &>(m_range).begin(), m_it);
+        }
+
+        Range m_range;
+        iterator m_it;
+    };
+
+    /**
+     * Generator reading values between iterators, empty `PipeMaybe` means end.
+     * @tparam It iterator type
+     */
+    template<typename It>
+    class PipeIteratorGenerator {
+    public:
+        using self = PipeIteratorGenerator;
+        using value_type = typename std::iterator_traits<It>::value_type;
+
+        PipeIteratorGenerator(It beg, It end)
+                : m_it(beg), m_end(end) {}
+
+        PipeMaybe<value_type> operator()() {
+            if (m_it == m_end) return {};
+            return PipeMaybe<value_type>(*m_it++);
+        }
+
+    private:
+        It m_it;
+        It m_end;
+    };
+
+    /**
+     * Make allocation-free generator, for map function expanding one data into range.
+     * @param range owned range, each value is moved out once
+     */
+    template<typename Range, typename=typename std::enable_if<
+            is_iterable<Range>::value>::type>
+    inline PipeRangeGenerator<typename std::decay<Range>::type> make_range_generator(Range &&range) {
+        return PipeRangeGenerator<typename std::decay<Range>::type>(std::forward<Range>(range));
+    }
+
+    template<typename It, typename=typename std::enable_if<
+            has_iterator_tag<It, std::input_iterator_tag>::value>::type>
+    inline PipeIteratorGenerator<It> make_range_generator(It beg, It end) {
+        return PipeIteratorGenerator<It>(beg, end);
+    }
+}
+
+#endif //OMEGA_PIPE_MAYBE_H
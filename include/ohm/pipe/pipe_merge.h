@@ -0,0 +1,369 @@
+//
+// Created by kier on 2020/12/13.
+//
+
+#ifndef OMEGA_PIPE_MERGE_H
+#define OMEGA_PIPE_MERGE_H
+
+#include "pipe.h"
+
+#include <list>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+namespace ohm {
+    /**
+     * Join values of several inputs by key.
+     * Keys waiting for other inputs are bounded by `capacity`, the oldest one is evicted when full.
+     * @tparam T value type
+     * @tparam K key type, need `operator<`
+     */
+    template<typename T, typename K>
+    class PipeZip {
+    public:
+        using self = PipeZip;
+        using Emitter = std::function<void(std::vector<T>)>;
+
+        /**
+         * @param inputs number of inputs
+         * @param capacity max number of keys waiting
+         * @param emitter called with values of one key, in inputs order
+         */
+        PipeZip(size_t inputs, size_t capacity, Emitter emitter)
+                : m_inputs(inputs), m_capacity(capacity > 0 ? capacity : 1)
+                , m_emitter(std::move(emitter)), m_pending(0), m_evicted(0) {
+        }
+
+        PipeZip(const PipeZip &) = delete;
+
+        PipeZip &operator=(const PipeZip &) = delete;
+
+        /**
+         * Add value from input `index`.
+         * @param index input index
+         * @param key key of value
+         * @param value value
+         */
+        void push(size_t index, const K &key, T value) {
+            std::vector<T> joined;
+            {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                auto it = m_index.find(key);
+                if (it == m_index.end()) {
+                    if (m_entries.size() >= m_capacity) {
+                        m_index.erase(m_entries.front().key);
+                        m_entries.pop_front();
+                        ++m_evicted;
+                    }
+                    m_entries.emplace_back(key);
+                    it = m_index.insert(std::make_pair(key, std::prev(m_entries.end()))).first;
+                }
+                auto &parts = it->second->parts;
+                auto part = parts.find(index);
+                if (part != parts.end()) {
+                    // duplicated key in one input, keep the newer one
+                    part->second = std::move(value);
+                } else {
+                    parts.insert(std::make_pair(index, std::move(value)));
+                }
+                if (parts.size() == m_inputs) {
+                    joined.reserve(m_inputs);
+                    for (auto &pair : parts) joined.push_back(std::move(pair.second));
+                    m_entries.erase(it->second);
+                    m_index.erase(it);
+                }
+                m_pending = m_entries.size();
+            }
+            if (!joined.empty()) m_emitter(std::move(joined));
+        }
+
+        /**
+         * Drop all waiting keys, counted as evicted.
+         */
+        void flush() {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            m_evicted += int64_t(m_entries.size());
+            m_entries.clear();
+            m_index.clear();
+            m_pending = 0;
+        }
+
+        /**
+         * @return number of keys waiting for other inputs
+         */
+        int64_t pending() const {
+            return int64_t(m_pending);
+        }
+
+        /**
+         * @return number of keys evicted before all inputs arrived
+         */
+        int64_t evicted() const {
+            return m_evicted;
+        }
+
+    private:
+        struct Entry {
+            K key;
+            std::map<size_t, T> parts;  ///< input index to value
+
+            explicit Entry(const K &key) : key(key) {}
+        };
+
+        size_t m_inputs;
+        size_t m_capacity;
+        Emitter m_emitter;
+
+        std::mutex m_mutex;
+        std::list<Entry> m_entries;     ///< oldest first
+        std::map<K, typename std::list<Entry>::iterator> m_index;
+        std::atomic<size_t> m_pending;
+        std::atomic<int64_t> m_evicted;
+    };
+
+    /**
+     * Merge several inputs into one output, ordered by timestamp.
+     * Value is emitted when every open input has buffered value, so the smallest one is known.
+     * If more than `capacity` values buffered, the smallest one is emitted anyway,
+     * values come later with smaller timestamp are dropped as late.
+     * @tparam T value type
+     * @tparam S timestamp type, need `operator<`
+     */
+    template<typename T, typename S>
+    class PipeTimeMerge {
+    public:
+        using self = PipeTimeMerge;
+        using Emitter = std::function<void(T)>;
+        using Closer = std::function<void()>;
+
+        /**
+         * @param inputs number of inputs
+         * @param capacity max number of buffered values
+         * @param emitter called in timestamp order, only one thread calling at a time.
+         * @param closer called after all inputs closed and all values emitted.
+         */
+        PipeTimeMerge(size_t inputs, size_t capacity, Emitter emitter, Closer closer)
+                : m_capacity(capacity > 0 ? capacity : 1)
+                , m_emitter(std::move(emitter)), m_closer(std::move(closer))
+                , m_counts(inputs, 0), m_open(inputs, true), m_opened(inputs)
+                , m_emitting(false), m_has_last(false), m_buffered(0), m_late(0) {
+        }
+
+        PipeTimeMerge(const PipeTimeMerge &) = delete;
+
+        PipeTimeMerge &operator=(const PipeTimeMerge &) = delete;
+
+        /**
+         * Add value from input `index`.
+         */
+        void push(size_t index, const S &stamp, T value) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (m_has_last && stamp < m_last) {
+                ++m_late;
+                return;
+            }
+            m_values.insert(std::make_pair(stamp, std::make_pair(index, std::move(value))));
+            ++m_counts[index];
+            emit(_lock);
+        }
+
+        /**
+         * Tell input `index` will not push any more.
+         */
+        void close(size_t index) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (!m_open[index]) return;
+            m_open[index] = false;
+            --m_opened;
+            emit(_lock);
+        }
+
+        /**
+         * @return number of values buffered
+         */
+        int64_t buffered() const {
+            return int64_t(m_buffered);
+        }
+
+        /**
+         * @return number of values dropped for coming after later values emitted
+         */
+        int64_t late() const {
+            return m_late;
+        }
+
+    private:
+        size_t m_capacity;
+        Emitter m_emitter;
+        Closer m_closer;
+
+        std::mutex m_mutex;
+        std::multimap<S, std::pair<size_t, T>> m_values;
+        std::vector<size_t> m_counts;   ///< buffered values of each input
+        std::vector<bool> m_open;
+        size_t m_opened;
+        bool m_emitting;
+        bool m_has_last;
+        S m_last;                       ///< timestamp of last emitted value
+
+        std::atomic<size_t> m_buffered;
+        std::atomic<int64_t> m_late;
+
+        bool ready() const {
+            if (m_values.empty()) return false;
+            if (m_values.size() > m_capacity) return true;
+            for (size_t i = 0; i < m_counts.size(); ++i) {
+                if (m_open[i] && m_counts[i] == 0) return false;
+            }
+            return true;
+        }
+
+        /**
+         * Emit ready values in order, emitter called without lock.
+         */
+        void emit(std::unique_lock<std::mutex> &lock) {
+            m_buffered = m_values.size();
+            if (m_emitting) return;    // the emitting thread will check again
+            m_emitting = true;
+            std::vector<T> ready;
+            while (true) {
+                while (this->ready()) {
+                    auto it = m_values.begin();
+                    m_last = it->first;
+                    m_has_last = true;
+                    --m_counts[it->second.first];
+                    ready.push_back(std::move(it->second.second));
+                    m_values.erase(it);
+                }
+                m_buffered = m_values.size();
+                if (ready.empty()) break;
+                lock.unlock();
+                for (auto &value : ready) m_emitter(std::move(value));
+                ready.clear();
+                lock.lock();
+            }
+            m_emitting = false;
+            if (m_opened == 0 && m_values.empty() && m_closer) {
+                auto closer = std::move(m_closer);
+                m_closer = nullptr;
+                lock.unlock();
+                closer();
+                lock.lock();
+            }
+        }
+    };
+
+    /**
+     * Merge values of pipes into one pipe, in any order.
+     * @param pipes input pipes
+     * @return merged pipe, closed after all input pipes closed.
+     * @notice input pipes are sealed, values are forwarded in pushing threads.
+     */
+    template<typename T>
+    Pipe<T> merge(const std::vector<Pipe<T>> &pipes) {
+        if (pipes.empty()) throw Exception("Can not merge no pipe.");
+        Pipe<T> merged(pipes.front().profiler());
+        auto remain = std::make_shared<std::atomic<size_t>>(pipes.size());
+        for (auto pipe : pipes) {
+            pipe.seal([merged](T data) {
+                const_cast<Pipe<T> &>(merged).push(std::move(data));
+            });
+            pipe.attach(merged);
+            pipe.queue().on_finished([merged, remain]() {
+                if (--*remain == 0) const_cast<Pipe<T> &>(merged).close();
+            });
+        }
+        return merged;
+    }
+
+    template<typename T>
+    Pipe<T> merge(std::initializer_list<Pipe<T>> pipes) {
+        return merge(std::vector<Pipe<T>>(pipes));
+    }
+
+    /**
+     * Join values of pipes with the same key, like frame id.
+     * @param pipes input pipes
+     * @param key key function, take `const T &`, return key.
+     * @param capacity max number of keys waiting for other pipes, the oldest one is evicted when full.
+     * @return joined pipe, each value contains one value of each input pipe, in input order.
+     * @notice metric "zip.pending" and "zip.evicted" are reported in the profile line of joined pipe.
+     */
+    template<typename T, typename FUNC>
+    auto zip_by_key(const std::vector<Pipe<T>> &pipes, FUNC key, size_t capacity = 64)
+    -> Pipe<std::vector<T>> {
+        using Key = typename std::decay<decltype(key(std::declval<const T &>()))>::type;
+        if (pipes.empty()) throw Exception("Can not zip no pipe.");
+        Pipe<std::vector<T>> zipped(pipes.front().profiler());
+        auto zip = std::make_shared<PipeZip<T, Key>>(pipes.size(), capacity, [zipped](std::vector<T> values) {
+            const_cast<Pipe<std::vector<T>> &>(zipped).push(std::move(values));
+        });
+        auto remain = std::make_shared<std::atomic<size_t>>(pipes.size());
+        for (size_t i = 0; i < pipes.size(); ++i) {
+            auto pipe = pipes[i];
+            pipe.seal([zip, key, i](T data) {
+                auto k = key(static_cast<const T &>(data));
+                zip->push(i, k, std::move(data));
+            });
+            pipe.attach(zipped);
+            pipe.queue().on_finished([zipped, zip, remain]() {
+                if (--*remain != 0) return;
+                zip->flush();
+                const_cast<Pipe<std::vector<T>> &>(zipped).close();
+            });
+        }
+        std::weak_ptr<PipeZip<T, Key>> weak = zip;
+        zipped.metric("zip.pending", [weak]() -> int64_t {
+            auto zip = weak.lock();
+            return zip ? zip->pending() : 0;
+        });
+        zipped.metric("zip.evicted", [weak]() -> int64_t {
+            auto zip = weak.lock();
+            return zip ? zip->evicted() : 0;
+        });
+        return zipped;
+    }
+
+    /**
+     * Merge values of pipes in timestamp order, like syncing frames of multi-camera.
+     * Values in each pipe should be in timestamp order.
+     * @param pipes input pipes
+     * @param stamp timestamp function, take `const T &`, return timestamp.
+     * @param capacity max number of values buffered, the smallest one is emitted when full.
+     * @return merged pipe, values in timestamp order, closed after all input pipes closed.
+     * @notice metric "merge.buffered" and "merge.late" are reported in the profile line of merged pipe.
+     */
+    template<typename T, typename FUNC>
+    Pipe<T> merge_by_time(const std::vector<Pipe<T>> &pipes, FUNC stamp, size_t capacity = 64) {
+        using Stamp = typename std::decay<decltype(stamp(std::declval<const T &>()))>::type;
+        if (pipes.empty()) throw Exception("Can not merge no pipe.");
+        Pipe<T> merged(pipes.front().profiler());
+        auto state = std::make_shared<PipeTimeMerge<T, Stamp>>(
+                pipes.size(), capacity,
+                [merged](T data) { const_cast<Pipe<T> &>(merged).push(std::move(data)); },
+                [merged]() { const_cast<Pipe<T> &>(merged).close(); });
+        for (size_t i = 0; i < pipes.size(); ++i) {
+            auto pipe = pipes[i];
+            pipe.seal([state, stamp, i](T data) {
+                auto s = stamp(static_cast<const T &>(data));
+                state->push(i, s, std::move(data));
+            });
+            pipe.attach(merged);
+            pipe.queue().on_finished([state, i]() { state->close(i); });
+        }
+        std::weak_ptr<PipeTimeMerge<T, Stamp>> weak = state;
+        merged.metric("merge.buffered", [weak]() -> int64_t {
+            auto state = weak.lock();
+            return state ? state->buffered() : 0;
+        });
+        merged.metric("merge.late", [weak]() -> int64_t {
+            auto state = weak.lock();
+            return state ? state->late() : 0;
+        });
+        return merged;
+    }
+}
+
+#endif //OMEGA_PIPE_MERGE_H
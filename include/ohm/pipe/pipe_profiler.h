@@ -8,69 +8,111 @@
 #include "../time.h"
 #include "../thread/queue_watcher.h"
 #include "../type_required.h"
+#include "../print.h"
+#include "../thread/work_stealing.h"
+#include "../thread/dispatcher_budget.h"
+#include "../thread/dispatcher_sampler.h"
+#include "pipe_histogram.h"
 
 #include <string>
+#include <future>
+#include <deque>
 
 namespace ohm {
-    template <typename T, typename=Required<std::is_integral<T>>>
-    class PipeAverageTime {
+    /**
+     * Processing time of stage, recorded lock-free in nanoseconds.
+     * Average is of the latest `window` time, however often reported, distribution is since beginning, in microseconds.
+     */
+    class PipeTimeWatcher {
     public:
-        using self = PipeAverageTime;
-
         /**
-         *
-         * @param N window size
+         * @param window average is of values processed in the latest `window` time
          */
-        explicit PipeAverageTime(size_t N = 60)
-            : m_size(N), m_sum(0), m_average(0) {
-        }
+        explicit PipeTimeWatcher(time::ms window = time::sec(2))
+            : m_state(new State(window)) {}
 
-        PipeAverageTime(const PipeAverageTime &) = delete;
+        ~PipeTimeWatcher() = default;
 
-        PipeAverageTime &operator=(const PipeAverageTime &) = delete;
+        std::function<void(time::ns)> time_reporter() {
+            auto state = m_state;
+            return [state](time::ns time) {
+                auto value = int64_t(time.count());
+                state->sum.add(value);
+                state->count.add(1);
+                state->histogram.record((value + 500) / 1000);
+            };
+        }
 
-        void push(T value) {
-            std::unique_lock<std::mutex> _lock(m_mutex);
-            m_values.push(value);
-            m_sum += value;
-            if (m_values.size() > m_size) {
-                m_sum -= m_values.front();
-                m_values.pop();
-            }
-            m_average = m_sum / T(m_values.size());
+        time::ns time() {
+            auto &state = *m_state;
+            std::unique_lock<std::mutex> _lock(state.mutex);
+            auto now_time = steady_now();
+            auto count = state.count.load();
+            auto sum = state.sum.load();
+            auto window = state.window.sample(now_time, count, sum);
+            // keep last average if no value processed in window
+            if (window.first > 0) state.average = int64_t(window.second / window.first);
+            return time::ns(state.average);
         }
 
-        T value() {
-            return m_average;
+        PipeHistogram::Summary summary() const {
+            return m_state->histogram.summary();
         }
 
     private:
-        size_t m_size;
-        T m_sum;
-        std::queue<T> m_values;
-        std::mutex m_mutex;
-        std::atomic<T> m_average;
+        struct State {
+            ShardedCounter sum;
+            ShardedCounter count;
+            PipeHistogram histogram;
+
+            std::mutex mutex;       ///< only taken by reports
+            CountWindow window;     ///< count and sum over the latest window
+            int64_t average = 0;
+
+            explicit State(time::ms window)
+                : window(window) {}
+        };
+
+        std::shared_ptr<State> m_state;
     };
 
-    class PipeTimeWatcher {
+    /**
+     * Distributions of queue-wait, service time and latency from origin, in microseconds.
+     */
+    class PipeTraceWatcher {
     public:
-        PipeTimeWatcher()
-            : m_average(new PipeAverageTime<int>(60)) {}
+        struct Report {
+            PipeHistogram::Summary wait;        ///< time waited in queue
+            PipeHistogram::Summary service;     ///< time processed by action
+            PipeHistogram::Summary latency;     ///< time from origin to processed, end-to-end latency at sink
+        };
 
-        ~PipeTimeWatcher() = default;
+        PipeTraceWatcher()
+            : m_histograms(new Histograms) {}
 
-        std::function<void(time::ms)> time_reporter() {
-            auto average = m_average;
-            return [average](time::ms time) {
-                average->push(int(time::count<time::ms>(time)));
+        std::function<void(time::us, time::us, time::us)> trace_reporter() {
+            auto histograms = m_histograms;
+            return [histograms](time::us wait, time::us service, time::us latency) {
+                histograms->wait.record(wait.count());
+                histograms->service.record(service.count());
+                histograms->latency.record(latency.count());
             };
         }
 
-        time::ms time() {
-            return time::ms(m_average->value());
+        Report report() const {
+            return {m_histograms->wait.summary(),
+                    m_histograms->service.summary(),
+                    m_histograms->latency.summary()};
         }
+
     private:
-        std::shared_ptr<PipeAverageTime<int>> m_average;
+        struct Histograms {
+            PipeHistogram wait;
+            PipeHistogram service;
+            PipeHistogram latency;
+        };
+
+        std::shared_ptr<Histograms> m_histograms;
     };
 
     class PipeStatus {
@@ -80,8 +122,57 @@ namespace ohm {
 
         QueueWatcher io_count;
         PipeTimeWatcher process_time;
+        PipeTraceWatcher trace;
         Getter<int64_t> capacity;
         Getter<int64_t> threads;
+        std::function<void(int64_t)> resize;    ///< change number of threads
+        std::function<void(const DispatcherSampling &)> sampling;   ///< change sampling of timing and tracing
+        std::map<std::string, Getter<int64_t>> metrics;  ///< stage specific metrics
+    };
+
+    /**
+     * Count unfinished stages of one pipe graph, and tell when all of them finished.
+     */
+    class PipeCompletion : public std::enable_shared_from_this<PipeCompletion> {
+    public:
+        using self = PipeCompletion;
+
+        PipeCompletion()
+                : m_unfinished(0), m_future(m_promise.get_future().share()) {
+        }
+
+        PipeCompletion(const PipeCompletion &) = delete;
+
+        PipeCompletion &operator=(const PipeCompletion &) = delete;
+
+        /**
+         * Add one unfinished stage.
+         * @return stage is finished when the returned token released.
+         */
+        std::shared_ptr<void> stage() {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            ++m_unfinished;
+            auto completion = shared_from_this();
+            return std::shared_ptr<void>(nullptr, [completion](void *) { completion->finish_stage(); });
+        }
+
+        /**
+         * @return future ready when all stages finished
+         */
+        std::shared_future<void> future() const {
+            return m_future;
+        }
+
+    private:
+        std::mutex m_mutex;
+        int64_t m_unfinished;
+        std::promise<void> m_promise;
+        std::shared_future<void> m_future;
+
+        void finish_stage() {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (--m_unfinished == 0) m_promise.set_value();
+        }
     };
 
     class PipeProfiler {
@@ -89,7 +180,10 @@ namespace ohm {
         struct Callback {
             std::function<void()> in;
             std::function<void()> out;
-            std::function<void(time::ms)> time;
+            std::function<void(time::ns)> time;     ///< processing time of each value
+            std::function<void(int64_t)> inputs;    ///< same as `in`, with number of values
+            std::function<void(int64_t)> outputs;   ///< same as `out`, with number of values
+            std::function<void(time::us, time::us, time::us)> trace;   ///< queue-wait, service and latency
         };
 
         template<typename T>
@@ -97,7 +191,8 @@ namespace ohm {
 
         Callback callback(const std::string &name,
                           const Getter<int64_t> &capacity = nullptr,
-                          const Getter<int64_t> &threads = nullptr) {
+                          const Getter<int64_t> &threads = nullptr,
+                          const std::function<void(int64_t)> &resize = nullptr) {
             auto it = m_status.find(name);
             if (it == m_status.end()) {
                 auto succeed = m_status.insert(std::make_pair(name, PipeStatus()));
@@ -107,9 +202,81 @@ namespace ohm {
             auto &status = it->second;
             status.capacity = capacity;
             status.threads = threads;
+            status.resize = resize;
             return {status.io_count.input_ticker(),
                     status.io_count.output_ticker(),
-                    status.process_time.time_reporter()};
+                    status.process_time.time_reporter(),
+                    status.io_count.input_counter(),
+                    status.io_count.output_counter(),
+                    status.trace.trace_reporter()};
+        }
+
+        /**
+         * Add named metric to the report line of queue `name`.
+         * @param name profile's queue name
+         * @param metric metric name
+         * @param getter read metric value when reporting
+         */
+        void metric(const std::string &name, const std::string &metric, const Getter<int64_t> &getter) {
+            auto it = m_status.find(name);
+            if (it == m_status.end()) {
+                auto succeed = m_status.insert(std::make_pair(name, PipeStatus()));
+                it = succeed.first;
+                m_lines.emplace_back(name);
+            }
+            it->second.metrics[metric] = getter;
+        }
+
+        /**
+         * Change number of threads of queue `name`.
+         * @param name profile's queue name
+         * @param threads number of threads
+         * @return false if queue can not be resized
+         */
+        bool resize(const std::string &name, int64_t threads) {
+            auto it = m_status.find(name);
+            if (it == m_status.end() || !it->second.resize) return false;
+            it->second.resize(threads);
+            return true;
+        }
+
+        /**
+         * Set how to change sampling policy of queue `name`.
+         * @param name profile's queue name
+         * @param setter set sampling policy of queue
+         */
+        void sampler(const std::string &name, const std::function<void(const DispatcherSampling &)> &setter) {
+            auto it = m_status.find(name);
+            if (it == m_status.end()) {
+                auto succeed = m_status.insert(std::make_pair(name, PipeStatus()));
+                it = succeed.first;
+                m_lines.emplace_back(name);
+            }
+            it->second.sampling = setter;
+        }
+
+        /**
+         * Change sampling policy of timing and tracing of queue `name`, at any time.
+         * @param name profile's queue name
+         * @param sampling sampling policy
+         * @return false if queue can not be sampled
+         */
+        bool sampling(const std::string &name, const DispatcherSampling &sampling) {
+            auto it = m_status.find(name);
+            if (it == m_status.end() || !it->second.sampling) return false;
+            it->second.sampling(sampling);
+            return true;
+        }
+
+        /**
+         * Record event, like decision of controller, the latest events are kept in report.
+         * @param name profile's queue name
+         * @param message event message
+         */
+        void event(const std::string &name, const std::string &message) {
+            std::unique_lock<std::mutex> _lock(m_event_mutex);
+            m_events.emplace_back(sprint("[", now(), "] ", name, ": ", message));
+            while (m_events.size() > 64) m_events.pop_front();
         }
 
         /**
@@ -121,30 +288,106 @@ namespace ohm {
                 QueueWatcher::Report queue; ///< queue status
                 int64_t capacity;    ///< size limit of queue
                 int64_t threads;     ///< number of threads to process
-                time::ms average_time;       ///< each processor average time
+                time::ns average_time;       ///< each processor average time
+                PipeHistogram::Summary time;    ///< distribution of processing time, in microseconds
+                std::map<std::string, int64_t> metrics;   ///< stage specific metrics, like reorder occupancy
+                PipeTraceWatcher::Report trace;   ///< only counted if pipes traced, in microseconds
             };
             std::vector<std::string> lines;
             std::map<std::string, Line> report;
+            std::vector<std::string> events;    ///< latest events, oldest first
         };
 
         Report report() {
             Report result;
             for (auto &pair : m_status) {
-                result.report.insert(std::make_pair(
-                        pair.first,
-                        Report::Line({pair.first,
-                                      pair.second.io_count.report(),
-                                      pair.second.capacity ? pair.second.capacity() : 0,
-                                      pair.second.threads ? pair.second.threads() : 0,
-                                      pair.second.process_time.time()})));
+                Report::Line line;
+                line.name = pair.first;
+                line.queue = pair.second.io_count.report();
+                line.capacity = pair.second.capacity ? pair.second.capacity() : 0;
+                line.threads = pair.second.threads ? pair.second.threads() : 0;
+                line.average_time = pair.second.process_time.time();
+                line.time = pair.second.process_time.summary();
+                line.trace = pair.second.trace.report();
+                for (auto &metric : pair.second.metrics) {
+                    line.metrics.insert(std::make_pair(metric.first, metric.second()));
+                }
+                result.report.insert(std::make_pair(pair.first, std::move(line)));
             }
             result.lines = m_lines;
+            {
+                std::unique_lock<std::mutex> _lock(m_event_mutex);
+                result.events.assign(m_events.begin(), m_events.end());
+            }
             return result;
         }
 
+        /**
+         * Trace values of pipes created after, see `DispatcherQueue::trace`.
+         */
+        void trace(bool on) {
+            m_tracing = on;
+        }
+
+        bool tracing() const {
+            return m_tracing;
+        }
+
+        /**
+         * Limit bytes of data in all pipes counting bytes, shared by pipes created after, see `DispatcherQueue::budget`.
+         * @param bytes max bytes, 0 means no limit
+         */
+        void budget(int64_t bytes) {
+            if (m_budget) {
+                m_budget->limit(bytes);
+            } else {
+                m_budget = std::make_shared<DispatcherBudget>(bytes);
+            }
+        }
+
+        std::shared_ptr<DispatcherBudget> budget() const {
+            return m_budget;
+        }
+
+        /**
+         * Fuse adjacent 1:1 stages of pipes mapped after, see `Pipe::fuse`.
+         */
+        void fuse(bool on) {
+            m_fusing = on;
+        }
+
+        bool fusing() const {
+            return m_fusing;
+        }
+
+        /**
+         * Set shared pool for pipes created after, nullptr for dedicated threads.
+         */
+        void executor(std::shared_ptr<WorkStealingPool> pool) {
+            m_executor = std::move(pool);
+        }
+
+        std::shared_ptr<WorkStealingPool> executor() const {
+            return m_executor;
+        }
+
+        /**
+         * @return completion of pipes sharing this profiler
+         */
+        const std::shared_ptr<PipeCompletion> &completion() const {
+            return m_completion;
+        }
+
     private:
         std::map<std::string, PipeStatus> m_status;
         std::vector<std::string> m_lines;
+        std::mutex m_event_mutex;
+        std::deque<std::string> m_events;
+        std::shared_ptr<WorkStealingPool> m_executor;
+        bool m_tracing = false;
+        bool m_fusing = false;
+        std::shared_ptr<DispatcherBudget> m_budget;
+        std::shared_ptr<PipeCompletion> m_completion = std::make_shared<PipeCompletion>();
     };
 }
 
@@ -0,0 +1,120 @@
+//
+// Created by kier on 2020/12/9.
+//
+
+#ifndef OMEGA_PIPE_REORDER_H
+#define OMEGA_PIPE_REORDER_H
+
+#include "../thread/work_stealing.h"
+
+#include <map>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace ohm {
+    /**
+     * Restore input order of outputs processed by several workers.
+     * Each input has a ticket, numbered from 0 in input order.
+     * Worker calls `wait(ticket)` before processing, and `done(ticket, outputs)` after.
+     * Outputs are emitted in ticket order, at most `window` tickets can be processing or buffered.
+     * @tparam T output type
+     */
+    template<typename T>
+    class PipeReorder {
+    public:
+        using self = PipeReorder;
+        using Emitter = std::function<void(T)>;
+
+        /**
+         * @param window max number of tickets after the oldest unfinished one, at least 1.
+         * @param emitter called in ticket order, only one thread calling at a time.
+         */
+        PipeReorder(size_t window, Emitter emitter)
+                : m_window(window > 0 ? int64_t(window) : 1)
+                , m_emitter(std::move(emitter))
+                , m_next(0), m_emitting(false), m_occupancy(0) {
+        }
+
+        PipeReorder(const PipeReorder &) = delete;
+
+        PipeReorder &operator=(const PipeReorder &) = delete;
+
+        /**
+         * Block until ticket is in window, so fast workers can not run too far ahead.
+         * Worker with the oldest ticket never waits, so it always makes progress.
+         * @param ticket ticket of processing input
+         * @note task run nested by `WorkStealingPool::help` does not wait, the earlier ticket may be below it.
+         *       Nested depth is limited, so the buffer is still bounded.
+         */
+        void wait(int64_t ticket) {
+            if (WorkStealingPool::current() && WorkStealingPool::depth() > 0) return;
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            while (ticket >= m_next + m_window) m_cond.wait(_lock);
+        }
+
+        /**
+         * Finish ticket, outputs will be emitted after all outputs of earlier tickets.
+         * @param ticket ticket of processed input
+         * @param outputs outputs of this ticket, could be empty
+         */
+        void done(int64_t ticket, std::vector<T> outputs) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            m_pending.insert(std::make_pair(ticket, std::move(outputs)));
+            if (m_emitting) {
+                // the emitting thread will emit this ticket
+                m_occupancy = m_pending.size();
+                return;
+            }
+            m_emitting = true;
+            std::vector<std::vector<T>> ready;
+            while (true) {
+                auto it = m_pending.begin();
+                while (it != m_pending.end() && it->first == m_next) {
+                    ready.emplace_back(std::move(it->second));
+                    it = m_pending.erase(it);
+                    ++m_next;
+                }
+                m_occupancy = m_pending.size();
+                if (ready.empty()) break;
+                m_cond.notify_all();
+                // emit without lock, emitter may block on full queue
+                _lock.unlock();
+                for (auto &values : ready) {
+                    for (auto &value : values) {
+                        m_emitter(std::move(value));
+                    }
+                }
+                ready.clear();
+                _lock.lock();
+            }
+            m_emitting = false;
+        }
+
+        /**
+         * @return number of finished tickets waiting for earlier tickets
+         */
+        int64_t occupancy() const {
+            return int64_t(m_occupancy);
+        }
+
+        int64_t window() const {
+            return m_window;
+        }
+
+    private:
+        int64_t m_window;
+        Emitter m_emitter;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        int64_t m_next;     ///< oldest unfinished ticket
+        bool m_emitting;
+        std::map<int64_t, std::vector<T>> m_pending;
+        std::atomic<size_t> m_occupancy;
+    };
+}
+
+#endif //OMEGA_PIPE_REORDER_H
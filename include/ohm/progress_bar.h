@@ -77,7 +77,7 @@ namespace ohm {
 
         progress_bar(int64_t min, int64_t max, int64_t value)
                 : m_min(min), m_max(max), m_value(value), m_paused_duration(0) {
-            m_last_show_time_point = now() - time::sec(3600);
+            m_last_show_time_point = steady_now() - time::sec(3600);
         }
 
         progress_bar(int64_t min, int64_t max) : progress_bar(min, max, min) {}
@@ -93,11 +93,11 @@ namespace ohm {
         void start() {
             switch (m_stat) {
                 default:
-                    m_start_time_point = now();
+                    m_start_time_point = steady_now();
                     reset();
                     break;
                 case WAITING:
-                    m_start_time_point = now();
+                    m_start_time_point = steady_now();
                     m_paused_duration = time::us(0);
                     reset();
                     break;
@@ -105,11 +105,11 @@ namespace ohm {
                     break;
                 case PAUSED:
                     m_paused_duration += std::chrono::duration_cast<time::us>(
-                            now() - m_pause_time_point);
+                            steady_now() - m_pause_time_point);
                     reset();
                     break;
                 case STOPPED:
-                    m_start_time_point = now();
+                    m_start_time_point = steady_now();
                     m_paused_duration = time::us(0);
                     reset();
                     break;
@@ -120,19 +120,19 @@ namespace ohm {
         void stop() {
             switch (m_stat) {
                 default:
-                    m_stop_time_point = now();
+                    m_stop_time_point = steady_now();
                     break;
                 case WAITING:
-                    m_start_time_point = now();
+                    m_start_time_point = steady_now();
                     m_stop_time_point = m_start_time_point;
                     break;
                 case RUNNING:
-                    m_stop_time_point = now();
+                    m_stop_time_point = steady_now();
                     break;
                 case PAUSED:
                     m_paused_duration += std::chrono::duration_cast<time::us>(
-                            now() - m_pause_time_point);
-                    m_stop_time_point = now();
+                            steady_now() - m_pause_time_point);
+                    m_stop_time_point = steady_now();
                     break;
                 case STOPPED:
                     break;
@@ -143,14 +143,14 @@ namespace ohm {
         void pause() {
             switch (m_stat) {
                 default:
-                    m_pause_time_point = now();
+                    m_pause_time_point = steady_now();
                     break;
                 case WAITING:
-                    m_start_time_point = now();
+                    m_start_time_point = steady_now();
                     m_pause_time_point = m_start_time_point;
                     break;
                 case RUNNING:
-                    m_pause_time_point = now();
+                    m_pause_time_point = steady_now();
                     break;
                 case PAUSED:
                     break;
@@ -220,7 +220,7 @@ namespace ohm {
                     return time::us(0);
                 case RUNNING:
                     return std::chrono::duration_cast<time::us>(
-                            now() - m_start_time_point) - m_paused_duration;
+                            steady_now() - m_start_time_point) - m_paused_duration;
                 case PAUSED:
                     return std::chrono::duration_cast<time::us>(
                             m_pause_time_point - m_start_time_point) - m_paused_duration;
@@ -306,7 +306,7 @@ namespace ohm {
         }
 
         std::ostream &wait_show(int ms, std::ostream &out) const {
-            auto now_time_point = now();
+            auto now_time_point = steady_now();
             auto wait_duration = std::chrono::duration_cast<time::us>(
                     now_time_point - m_last_show_time_point);
             if (wait_duration.count() >= ms) {
@@ -320,7 +320,7 @@ namespace ohm {
         // reset sample
         void reset() {
             m_sample_value = value();
-            m_sample_time_point = now();
+            m_sample_time_point = steady_now();
             m_vpus = 0;
         }
 
@@ -328,7 +328,7 @@ namespace ohm {
         void sample() {
             // 60 count or 1 secend simple rate
             auto now_value = value();
-            auto now_time_point = now();
+            auto now_time_point = steady_now();
             auto sample_time_duration = std::chrono::duration_cast<time::us>(
                     now_time_point - m_sample_time_point);
             auto sample_value_duration = now_value - m_sample_value;
@@ -348,18 +348,18 @@ namespace ohm {
 
         status m_stat = WAITING;
 
-        time_point m_start_time_point;
-        time_point m_stop_time_point;
-        time_point m_pause_time_point;
+        steady_point m_start_time_point;
+        steady_point m_stop_time_point;
+        steady_point m_pause_time_point;
         time::us m_paused_duration;
 
         mutable int64_t m_show_count = 0;
 
         int64_t m_sample_value = 0;
-        time_point m_sample_time_point;
+        steady_point m_sample_time_point;
         double m_vpus = 0; // values per microseconds
 
-        mutable time_point m_last_show_time_point;
+        mutable steady_point m_last_show_time_point;
     };
 }
 
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -412,6 +413,36 @@ namespace ohm {
             m_address = AnyAddress(address.addr(), address.len());
         }
 
+        /**
+         * Set timeout of each recv and send, which throw SocketIOException on timeout.
+         * @param ms timeout in milliseconds, 0 means wait forever
+         */
+        void timeout(int ms) {
+#if OHM_PLATFORM_OS_WINDOWS
+            DWORD value = DWORD(ms);
+#else
+            struct timeval value;
+            value.tv_sec = ms / 1000;
+            value.tv_usec = (ms % 1000) * 1000;
+#endif
+            auto option = reinterpret_cast<const char *>(&value);
+            if (::setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, option, sizeof(value)) == SOCKET_ERROR ||
+                ::setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, option, sizeof(value)) == SOCKET_ERROR) {
+                throw SocketSetupException(GetLastSocketError("set socket timeout failed: "));
+            }
+        }
+
+        /**
+         * Allow binding address in TIME_WAIT state, so restarted server can bind at once.
+         */
+        void reuse(bool on) {
+            int value = on ? 1 : 0;
+            if (::setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR,
+                             reinterpret_cast<const char *>(&value), sizeof(value)) == SOCKET_ERROR) {
+                throw SocketSetupException(GetLastSocketError("set socket reuse failed: "));
+            }
+        }
+
         Socket accept() const {
             AnyAddress addr;
             auto connected = ::accept(m_socket, addr.raddr(), &addr.rlen());
@@ -506,6 +537,10 @@ namespace ohm {
             return m_socket->send(buf, len, flags);
         }
 
+        void timeout(int ms) {
+            m_socket->timeout(ms);
+        }
+
         const Address &address() {
             return m_socket->address();
         }
@@ -522,6 +557,10 @@ namespace ohm {
     public:
         Server(Protocol protocol, const Address &address, int backlog = 16) {
             m_socket = std::make_shared<Socket>(protocol, address.family());
+#if !OHM_PLATFORM_OS_WINDOWS
+            // SO_REUSEADDR on Windows allows other process binding same port
+            m_socket->reuse(true);
+#endif
             m_socket->bind(address);
             m_socket->listen(backlog);
         }
@@ -18,6 +18,14 @@ namespace ohm {
             this->m_powder = std::thread(&Cartridge::operating, this);
         }
 
+        /**
+         * @param prepare called first in working thread, like setting affinity or priority.
+         */
+        explicit Cartridge(std::function<void()> prepare)
+                : m_dry(true), m_bullet(nullptr), m_shell(nullptr), m_prepare(std::move(prepare)) {
+            this->m_powder = std::thread(&Cartridge::operating, this);
+        }
+
         ~Cartridge() {
             m_dry = false;
             m_fire_cond.notify_all();
@@ -56,6 +64,7 @@ namespace ohm {
 
     private:
         void operating() {
+            if (m_prepare) m_prepare();
             std::unique_lock<std::mutex> locker(m_fire_mutex);
             while (m_dry) {
                 while (m_dry && !m_bullet) m_fire_cond.wait(locker);
@@ -75,6 +84,7 @@ namespace ohm {
         int m_signet;                         ///< the argument to call `bullet(signet)` and `shell(signet)`
         bullet_type m_bullet = nullptr;      ///< main function call in thread
         shell_type m_shell = nullptr;        ///< side function call after `bullet` called
+        std::function<void()> m_prepare;      ///< called once when thread started
 
         std::thread m_powder;                 ///< working thread
     };
@@ -0,0 +1,95 @@
+//
+// Created by kier on 2020/12/22.
+//
+
+#ifndef OMEGA_COARSE_CLOCK_H
+#define OMEGA_COARSE_CLOCK_H
+
+#include "../time.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ohm {
+    /**
+     * `steady_now` refreshed by a ticker thread each millisecond, reading it is one relaxed load.
+     * Used to stamp hot paths where millisecond is precise enough, like time of last value of queue.
+     * The ticker thread is shared by all coarse clocks, and runs while any of them exists.
+     */
+    class CoarseClock {
+    public:
+        using self = CoarseClock;
+
+        CoarseClock()
+                : m_ticker(Ticker::Get()) {}
+
+        /**
+         * @return steady time of latest tick, at most about 1 millisecond earlier than `steady_now`
+         */
+        steady_point now() const {
+            return steady_point(steady_point::duration(m_ticker->tick.load(std::memory_order_relaxed)));
+        }
+
+    private:
+        class Ticker {
+        public:
+            std::atomic<int64_t> tick;     ///< steady time of latest tick, in nanoseconds
+
+            Ticker(const Ticker &) = delete;
+
+            Ticker &operator=(const Ticker &) = delete;
+
+            Ticker()
+                    : tick(Now()), m_stopped(false) {
+                m_thread = std::thread([this]() {
+                    std::unique_lock<std::mutex> _lock(m_mutex);
+                    while (!m_stopped) {
+                        m_cond.wait_for(_lock, time::ms(1));
+                        tick.store(Now(), std::memory_order_relaxed);
+                    }
+                });
+            }
+
+            ~Ticker() {
+                {
+                    std::unique_lock<std::mutex> _lock(m_mutex);
+                    m_stopped = true;
+                    m_cond.notify_all();
+                }
+                m_thread.join();
+            }
+
+            /**
+             * @return shared ticker, started if no clock is using it
+             */
+            static std::shared_ptr<Ticker> Get() {
+                static std::mutex mutex;
+                static std::weak_ptr<Ticker> shared;
+                std::unique_lock<std::mutex> _lock(mutex);
+                auto ticker = shared.lock();
+                if (!ticker) {
+                    ticker = std::make_shared<Ticker>();
+                    shared = ticker;
+                }
+                return ticker;
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_cond;
+            bool m_stopped;
+            std::thread m_thread;
+
+            static int64_t Now() {
+                return steady_now().time_since_epoch().count();
+            }
+        };
+
+        std::shared_ptr<Ticker> m_ticker;
+    };
+}
+
+#endif //OMEGA_COARSE_CLOCK_H
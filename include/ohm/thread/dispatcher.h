@@ -9,6 +9,7 @@
 #include <deque>
 
 #include "cartridge.h"
+#include "placement.h"
 
 namespace ohm {
     // used to provide thread pool for dispatcher, support dynamic threads
@@ -167,6 +168,15 @@ namespace ohm {
             }
         }
 
+        /**
+         * Set placement of threads created after, created threads are not changed.
+         * @param placement applied in each new thread, the thread index is cartridge index
+         */
+        void placement(const ThreadPlacement &placement) {
+            std::unique_lock<std::mutex> locker(m_chest_mutex);
+            m_placement = placement;
+        }
+
         /**
          * same resize(0)
          */
@@ -222,7 +232,12 @@ namespace ohm {
             if (m_clip.size() >= clip_size) return;
             // auto modified = clip_size - m_clip.size();
             for (auto i = m_clip.size(); i < clip_size; ++i) {
-                m_clip.push_back(new Cartridge);
+                if (m_placement.empty()) {
+                    m_clip.push_back(new Cartridge);
+                } else {
+                    auto placement = m_placement;
+                    m_clip.push_back(new Cartridge([placement, i]() { placement.apply(i); }));
+                }
                 m_chest.push_back(int(i));
             }
         }
@@ -236,6 +251,8 @@ namespace ohm {
         std::deque<int> m_backup;   ///< save not used id to chest
 
         std::atomic<size_t> m_size; // using size
+
+        ThreadPlacement m_placement;    ///< applied in new threads
     };
 
     template<typename ...Args>
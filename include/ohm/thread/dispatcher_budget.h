@@ -0,0 +1,92 @@
+//
+// Created by kier on 2020/12/17.
+//
+
+#ifndef OMEGA_DISPATCHER_BUDGET_H
+#define OMEGA_DISPATCHER_BUDGET_H
+
+#include "../time.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace ohm {
+    /**
+     * Byte budget shared by queues, like all queues of one pipeline.
+     * Queues with size estimator acquire bytes of pushed values and release them when values taken out.
+     */
+    class DispatcherBudget {
+    public:
+        using self = DispatcherBudget;
+
+        /**
+         * @param limit max bytes of values in all queues, 0 means no limit.
+         */
+        explicit DispatcherBudget(int64_t limit = 0)
+                : m_limit(limit), m_used(0), m_waiters(0) {}
+
+        DispatcherBudget(const DispatcherBudget &) = delete;
+
+        DispatcherBudget &operator=(const DispatcherBudget &) = delete;
+
+        void limit(int64_t limit) {
+            m_limit = limit;
+            notify();
+        }
+
+        int64_t limit() const {
+            return m_limit;
+        }
+
+        /**
+         * @return bytes of values in all queues
+         */
+        int64_t used() const {
+            return m_used;
+        }
+
+        /**
+         * @param bytes bytes going to acquire
+         * @return if acquiring `bytes` exceeds limit
+         */
+        bool over(int64_t bytes) const {
+            auto limit = m_limit.load();
+            return limit > 0 && m_used.load() + bytes > limit;
+        }
+
+        void acquire(int64_t bytes) {
+            m_used += bytes;
+        }
+
+        void release(int64_t bytes) {
+            m_used -= bytes;
+            notify();
+        }
+
+        /**
+         * Wait until acquiring `bytes` not exceeding limit, or timeout.
+         */
+        void wait(int64_t bytes, time::ms timeout) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            ++m_waiters;
+            m_cond.wait_for(_lock, timeout, [&]() { return !over(bytes); });
+            --m_waiters;
+        }
+
+    private:
+        void notify() {
+            if (m_waiters.load() == 0) return;
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            m_cond.notify_all();
+        }
+
+        std::atomic<int64_t> m_limit;
+        std::atomic<int64_t> m_used;
+        std::atomic<int> m_waiters;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+    };
+}
+
+#endif //OMEGA_DISPATCHER_BUDGET_H
@@ -9,8 +9,15 @@
 #include <ohm/print.h>
 
 #include "dispatcher.h"
+#include "ring_buffer.h"
+#include "work_stealing.h"
+#include "spin_wait.h"
+#include "placement.h"
+#include "dispatcher_budget.h"
+#include "dispatcher_sampler.h"
 
 #include "../time.h"
+#include "../except.h"
 
 namespace ohm {
     class QueueEnd : public std::exception {};
@@ -22,9 +29,47 @@ namespace ohm {
         DISPATCH_FLUSH,      // discard all push action
     };
 
+    enum DispatcherStorage {
+        DISPATCH_STORAGE_DEQUE,  // std::deque guarded by mutex, no capacity limit.
+        DISPATCH_STORAGE_MPMC,   // lock-free bounded ring, any number of producers and consumers.
+        DISPATCH_STORAGE_SPSC,   // lock-free bounded ring, exactly one producer thread and one consumer thread.
+    };
+
+    enum DispatcherWait {
+        DISPATCH_WAIT_BLOCK,     // sleep on condition variable at once.
+        DISPATCH_WAIT_SPIN,      // spin a bounded number of times, then yield, then sleep.
+        DISPATCH_WAIT_POLL,      // never sleep, each waiting thread keeps one core busy.
+    };
+
+    /**
+     * Trace context of the value processing in current thread, see `DispatcherQueue::trace`.
+     * Values pushed while processing inherit its origin, so latency from source can be measured at sink.
+     */
+    class DispatcherTrace {
+    public:
+        using clock = MonotonicClock;
+
+        /**
+         * @return time the processing value entered the first traced queue,
+         *         default constructed if current thread is not processing traced value.
+         */
+        static clock::time_point &origin() {
+            static thread_local clock::time_point origin;
+            return origin;
+        }
+
+        /**
+         * @return time spent in timed actions called inside the running timed action, like intime actions,
+         *         used to report time of each action exclusively.
+         */
+        static clock::duration &nested() {
+            static thread_local clock::duration nested(0);
+            return nested;
+        }
+    };
+
     template<typename T, typename=typename std::enable_if<
-            std::is_copy_assignable<T>::value &&
-            std::is_copy_constructible<T>::value>::type>
+            std::is_move_constructible<T>::value>::type>
     class DispatcherQueue {
     public:
         using self = DispatcherQueue;
@@ -53,9 +98,18 @@ namespace ohm {
          * @param limit
          */
         explicit DispatcherQueue(int64_t limit = -1)
-                : m_running(true), m_limit(limit)
+                : m_lane_size(0), m_laned(0), m_aging(0), m_ttl(0), m_has_deadline(false), m_expired(0)
+                , m_bytes(0), m_byte_limit(0)
+                , m_tracing(false)
+                , m_running(true), m_limit(limit)
                 , m_mode(DISPATCH_KEEP_WAIT)
-                , m_in_action([](){}), m_out_action([](){}) {
+                , m_in_action([](int64_t){}), m_out_action([](int64_t){})
+                , m_batch(1)
+                , m_storage(DISPATCH_STORAGE_DEQUE)
+                , m_evict(0), m_wait(DISPATCH_WAIT_BLOCK), m_spin(0), m_placed(0)
+                , m_closed(false), m_finished(false), m_workers(0), m_retire(0)
+                , m_ticketing(false), m_ticket(0)
+                , m_slot_limit(size_t(-1)), m_active(0), m_idle(0) {
         }
 
         ~DispatcherQueue() {
@@ -75,12 +129,93 @@ namespace ohm {
             auto action = Action(func);
             if (intime) {
                 this->m_intime_action = action;
+            } else if (m_pool) {
+                this->m_intime_action = nullptr;
+                {
+                    std::unique_lock<std::mutex> _lock(m_slot_mutex);
+                    m_free.push_back(m_slots.size());
+                    m_slots.push_back(action);
+                    ++m_idle;
+                }
+                if (size() > 0) schedule();
             } else {
                 this->m_intime_action = nullptr;
+                ++m_workers;
                 m_threads.emplace_back(std::make_shared<Thread>(action, &self::operating, this, action));
             }
         }
 
+        /**
+         * Tell queue no more value will be pushed.
+         * Binded actions process all values left in queue, then workers exit without polling.
+         * Actions added by `on_finished` are called after the last value processed.
+         * @note push to closed queue throws Exception; `pop` throws QueueEnd when closed queue is empty.
+         * @note if no action binded, queue finishes immediately, values left are kept for `pop`.
+         */
+        void close() {
+            {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                if (m_closed) return;
+                m_closed = true;
+                signal(m_pop_event, true);
+            }
+            if (m_pool && !m_slots.empty()) {
+                finish_if_drained();
+            } else if (m_workers.load() == 0) {
+                finish();
+            }
+        }
+
+        /**
+         * @return if `close` called
+         */
+        bool closed() const {
+            return m_closed;
+        }
+
+        /**
+         * @return if queue closed and all values processed
+         */
+        bool finished() const {
+            return m_finished;
+        }
+
+        /**
+         * Add action called once after queue closed and all values processed.
+         * @param action called in the thread processed last value, or called now if already finished.
+         */
+        void on_finished(std::function<void()> action) {
+            {
+                std::unique_lock<std::mutex> _lock(m_finish_mutex);
+                if (!m_finished) {
+                    m_finish_actions.emplace_back(std::move(action));
+                    return;
+                }
+            }
+            action();
+        }
+
+        /**
+         * Run binded actions on shared pool instead of dedicated threads.
+         * Each binded action becomes one concurrency slot, so number of binded actions limits concurrency.
+         * @param pool shared pool, nullptr for dedicated threads
+         * @note only can be called before any action binded.
+         * @note with DISPATCH_STORAGE_SPSC, only one action can be binded.
+         */
+        void executor(std::shared_ptr<WorkStealingPool> pool) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change executor of DispatcherQueue after action binded.");
+            }
+            m_pool = std::move(pool);
+        }
+
+        /**
+         * @return shared pool running binded actions, nullptr if using dedicated threads
+         */
+        std::shared_ptr<WorkStealingPool> executor() const {
+            return m_pool;
+        }
+
         /**
          * bind N processor with action(first parameter shuold be thread-id)
          * @tparam FUNC
@@ -96,7 +231,7 @@ namespace ohm {
             }
             for (size_t i = 0; i < N; ++i) {
                 auto action = [i, func](T t) {
-                    func(int(i), t);
+                    func(int(i), std::move(t));
                 };
                 this->bind(std::move(action));
             }
@@ -108,60 +243,109 @@ namespace ohm {
          * @param data push data
          */
         void push(T data) {
+            push_to(data, unclassified);
+        }
+
+        /**
+         * Add number of data to queue with one lock acquisition.
+         * `limit` and mode work on each data.
+         * @tparam It iterator type, use std::make_move_iterator to move data into queue.
+         * @param beg begin iterator
+         * @param end end iterator
+         */
+        template<typename It, typename=typename std::enable_if<
+                std::is_constructible<T, typename std::iterator_traits<It>::reference>::value>::type>
+        void push_bulk(It beg, It end) {
+            if (m_closed) throw Exception("Can not push to closed DispatcherQueue.");
             auto mode = m_mode.load();
             if (mode == DISPATCH_FLUSH) {
                 return;
             }
             if (m_intime_action) {
-                m_intime_action(std::move(data));
+                for (; beg != end; ++beg) run_intime(T(*beg));
                 return;
             }
-            std::unique_lock<std::mutex> _lock(m_mutex);
-            while (true) {
-                auto limit = m_limit.load();
-                if (limit <= 0 || int64_t(m_deque.size()) < limit) {
-                    break;
+            if (m_storage != DISPATCH_STORAGE_DEQUE) {
+                for (; beg != end; ++beg) {
+                    T data(*beg);
+                    ring_push(data, mode);
                 }
-                if (mode == DISPATCH_KEEP_WAIT) {
-                    m_cond_push.wait(_lock);
-                    mode = m_mode.load();
-                } else if (mode == DISPATCH_KEEP_NEW) {
-                    while (int64_t(m_deque.size()) >= limit) {
-                        m_deque.pop_front();
+                return;
+            }
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            int64_t pending = 0;
+            for (; beg != end; ++beg) {
+                if (!m_lanes.empty() || m_sizer) {
+                    T data(*beg);
+                    auto lane = classify(data);
+                    auto bytes = bytes_of(data);
+                    if (!deque_reserve(_lock, mode, pending, lane, bytes)) {
+                        if (mode == DISPATCH_FLUSH) break;
+                        continue;
                     }
-                    break;
-                } else if (mode == DISPATCH_KEEP_OLD) {
-                    return;
+                    deque_put(std::move(data), lane, bytes);
+                    ++pending;
+                    continue;
                 }
+                if (!deque_reserve(_lock, mode, pending)) {
+                    if (mode == DISPATCH_FLUSH) break;
+                    continue;
+                }
+                m_deque.emplace_back(*beg);
+                ++pending;
             }
-            m_deque.push_back(std::move(data));
-            m_cond_pop.notify_one();
-            m_in_action();
+            if (pending > 0) signal(m_pop_event, pending > 1);
+            _lock.unlock();
+            m_in_action(pending);
+            schedule();
+        }
+
+        /**
+         * Move all data in vector to queue with one lock acquisition.
+         * @param data pushing data
+         */
+        void push_bulk(std::vector<T> data) {
+            push_bulk(std::make_move_iterator(data.begin()), std::make_move_iterator(data.end()));
         }
 
         /**
          * wait until queue empty
          */
         void join() {
+            if (m_storage != DISPATCH_STORAGE_DEQUE) {
+                park(m_push_event, [&]() { return ring_size() == 0; });
+                return;
+            }
             std::unique_lock<std::mutex> _lock(m_mutex);
-            while (!m_deque.empty()) m_cond_push.wait(_lock);
+            while (!deque_empty()) idle(_lock, m_push_event);
         }
 
         /**
          * Clear all the binded actions.
          */
         void clear() {
+            std::unique_lock<std::mutex> _resize_lock(m_resize_mutex);
             m_running = false;
-            m_cond_pop.notify_all();
+            wake_all(m_pop_event);
             m_threads.clear();
+            m_retire = 0;
+            m_retired.clear();
+            {
+                std::unique_lock<std::mutex> _lock(m_slot_mutex);
+                while (m_active > 0) m_slot_cond.wait(_lock);
+                m_slots.clear();
+                m_free.clear();
+                m_idle = 0;
+                m_slot_limit = size_t(-1);
+            }
             m_intime_action = nullptr;
             m_running.store(true);
         }
 
         size_t size() const {
+            if (m_storage != DISPATCH_STORAGE_DEQUE) return ring_size();
             std::unique_lock<std::mutex> _lock(m_mutex);
-            return m_deque.size();
-
+            return deque_size();
         }
 
         /**
@@ -170,7 +354,7 @@ namespace ohm {
          */
         void dispose() {
             m_running = false;
-            m_cond_pop.notify_all();
+            wake_all(m_pop_event);
         }
 
         /**
@@ -178,23 +362,68 @@ namespace ohm {
          * @return top value of queue.
          */
         T pop() {
+            if (m_storage != DISPATCH_STORAGE_DEQUE) {
+                Popped popped;
+                if (!ring_wait_pop(popped)) throw QueueEnd();
+                m_out_action(1);
+                return std::move(popped.get());
+            }
             std::unique_lock<std::mutex> _lock(m_mutex);
             while (true) {
                 if (!m_running) throw QueueEnd();
-                if (m_deque.empty()) {
-                    m_cond_pop.wait(_lock);
+                deque_expire();
+                if (deque_empty()) {
+                    if (m_closed) throw QueueEnd();
+                    idle(_lock, m_pop_event);
                 } else {
                     break;
                 }
             }
             if (!m_running) throw QueueEnd();
-            auto tmp = m_deque.front();
-            m_deque.pop_front();
-            m_cond_push.notify_one();
-            m_out_action();
+            auto tmp = deque_take();
+            signal(m_push_event, false);
+            _lock.unlock();
+            m_out_action(1);
             return tmp;
         }
 
+        /**
+         * Return at most `max` values from queue, block until there is at least one value.
+         * If no data will be add, there will throw QueueEnd exception.
+         * @param max max number of values
+         * @return values in queue order
+         */
+        std::vector<T> pop_bulk(size_t max) {
+            std::vector<T> values;
+            if (max == 0) return values;
+            if (m_storage != DISPATCH_STORAGE_DEQUE) {
+                if (!ring_wait_pop_bulk(values, max)) throw QueueEnd();
+                m_out_action(int64_t(values.size()));
+                return values;
+            }
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (!deque_wait_pop_bulk(_lock, values, max)) throw QueueEnd();
+            _lock.unlock();
+            m_out_action(int64_t(values.size()));
+            return values;
+        }
+
+        /**
+         * Set number of values each worker drains from queue at one time.
+         * Worker runs drained values back to back, with one lock acquisition and one wakeup.
+         * @param size batch size, default is 1
+         */
+        void batch(size_t size) {
+            m_batch = size < 1 ? 1 : size;
+        }
+
+        /**
+         * @return number of values each worker drains at one time
+         */
+        size_t batch() const {
+            return m_batch;
+        }
+
         /**
          * Return queue limit size, return -1 if no limits
          * @return queue limit size
@@ -211,16 +440,361 @@ namespace ohm {
             m_limit = size;
         }
 
+        /**
+         * Select storage of queue.
+         * Ring storages are lock-free and bounded by `capacity`, `limit` still works if it is smaller.
+         * @param storage storage type
+         * @param capacity ring capacity, 0 means using `limit`, or 1024 if no limit set.
+         * @note only can be called before any action binded and when queue is empty.
+         * @note with DISPATCH_STORAGE_SPSC, only one thread can `push` and only one thread can pop.
+         *       `DISPATCH_KEEP_NEW` discarding is done lazily by consumer, so the default capacity is twice of `limit`,
+         *       and new value will be discarded if the ring is still full.
+         */
+        void storage(DispatcherStorage storage, size_t capacity = 0) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change storage of DispatcherQueue after action binded.");
+            }
+            if (size() != 0) {
+                throw Exception("Can not change storage of not empty DispatcherQueue.");
+            }
+            if (storage != DISPATCH_STORAGE_DEQUE && (m_lane_size > 1 || m_ttl.count() > 0)) {
+                throw Exception("Priority lanes and TTL only work with DISPATCH_STORAGE_DEQUE.");
+            }
+            if (storage != DISPATCH_STORAGE_DEQUE && m_sizer) {
+                throw Exception("Byte limits only work with DISPATCH_STORAGE_DEQUE.");
+            }
+            if (capacity == 0) {
+                auto limit = m_limit.load();
+                capacity = limit > 0 ? size_t(limit) : 1024;
+                if (storage == DISPATCH_STORAGE_SPSC) capacity *= 2;
+            }
+            m_mpmc.reset();
+            m_spsc.reset();
+            m_evict = 0;
+            switch (storage) {
+                default:
+                    break;
+                case DISPATCH_STORAGE_MPMC:
+                    m_mpmc.reset(new MPMCRingBuffer<T>(capacity));
+                    break;
+                case DISPATCH_STORAGE_SPSC:
+                    m_spsc.reset(new SPSCRingBuffer<T>(capacity));
+                    break;
+            }
+            m_storage = storage;
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            restamp();
+        }
+
+        /**
+         * @return storage of queue
+         */
+        DispatcherStorage storage() const {
+            return DispatcherStorage(m_storage);
+        }
+
+        /**
+         * Split queue into `size` priority lanes, workers always serve lane 0 first, then lane 1, and so on.
+         * Value is put in lane given by `push(data, lane)`, or by classifier set by `classify`,
+         * or in the last lane if no classifier.
+         * @param size number of lanes, 0 or 1 means plain FIFO queue.
+         * @param aging value waited longer than `aging` is served before values of higher lanes
+         *              which waited shorter, to prevent starvation. 0 means never.
+         * @note only work with DISPATCH_STORAGE_DEQUE.
+         * @note only can be called before any action binded and when queue is empty.
+         */
+        void lanes(size_t size, time::us aging = time::us(0)) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change lanes of DispatcherQueue after action binded.");
+            }
+            if (size > 1 && m_storage != DISPATCH_STORAGE_DEQUE) {
+                throw Exception("Priority lanes only work with DISPATCH_STORAGE_DEQUE.");
+            }
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (!m_deque.empty() || m_laned != 0) {
+                throw Exception("Can not change lanes of not empty DispatcherQueue.");
+            }
+            m_lane_size = size;
+            m_lanes.clear();
+            restamp();
+            m_aging = aging;
+        }
+
+        /**
+         * @return number of lanes, 1 for plain FIFO queue.
+         */
+        size_t lanes() const {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            return m_lanes.empty() ? 1 : m_lanes.size();
+        }
+
+        /**
+         * Set limit and mode of one lane, instead of `limit` and mode of queue.
+         * @param index lane index
+         * @param limit max size of this lane, 0 or negative means using `limit` of queue.
+         * @param mode what to do when this lane is full.
+         */
+        void lane(size_t index, int64_t limit, DispatcherMode mode) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (index >= m_lanes.size()) throw Exception("Lane index out of range.");
+            m_lanes[index].limit = limit;
+            m_lanes[index].mode = mode;
+        }
+
+        /**
+         * Set classifier used by `push(data)` to select lane.
+         * @param classifier return lane index of value, out of range index means the last lane.
+         * @note classifier is called with queue locked, keep it cheap.
+         */
+        void classify(std::function<size_t(const T &)> classifier) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            m_classifier = std::move(classifier);
+        }
+
+        /**
+         * Add data to given lane.
+         * @param data push data
+         * @param lane lane index, out of range index means the last lane.
+         */
+        void push(T data, size_t lane) {
+            push_to(data, lane != unclassified ? lane : lane - 1);
+        }
+
+        /**
+         * @return number of values in lane
+         */
+        int64_t lane_size(size_t index) const {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            return index < m_lanes.size() ? int64_t(m_lanes[index].values.size()) : 0;
+        }
+
+        /**
+         * @return smoothed time values waited in lane before popped, in microseconds
+         */
+        int64_t lane_wait(size_t index) const {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            return index < m_lanes.size() ? m_lanes[index].wait : 0;
+        }
+
+        /**
+         * Discard value at dequeue if it waited longer than `ttl` in queue, workers never process stale values.
+         * @param ttl max waiting time, 0 means never expire.
+         * @note only work with DISPATCH_STORAGE_DEQUE, as values are stamped when pushed.
+         * @note only can be called before any action binded and when queue is empty.
+         */
+        void ttl(time::us ttl) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change ttl of DispatcherQueue after action binded.");
+            }
+            if (ttl.count() > 0 && m_storage != DISPATCH_STORAGE_DEQUE) {
+                throw Exception("TTL only works with DISPATCH_STORAGE_DEQUE, use deadline for ring storages.");
+            }
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (!m_deque.empty() || m_laned != 0) {
+                throw Exception("Can not change ttl of not empty DispatcherQueue.");
+            }
+            m_ttl = ttl;
+            restamp();
+        }
+
+        time::us ttl() const {
+            return m_ttl;
+        }
+
+        /**
+         * Discard value at dequeue if its deadline passed.
+         * @param deadline take `const T &`, return deadline of value on steady clock, nullptr means no deadline.
+         * @note work with all storages, deadline is called when value popped, keep it cheap.
+         * @note only can be called before any action binded.
+         */
+        void deadline(std::function<std::chrono::steady_clock::time_point(const T &)> deadline) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change deadline of DispatcherQueue after action binded.");
+            }
+            m_deadline = std::move(deadline);
+            m_has_deadline = bool(m_deadline);
+        }
+
+        /**
+         * @return if deadline set
+         */
+        bool has_deadline() const {
+            return m_has_deadline;
+        }
+
+        /**
+         * Count bytes of values in queue, used by `byte_limit` and `budget`.
+         * @param sizer take `const T &`, return estimated bytes of value, must return the same bytes for same value.
+         * @note only work with DISPATCH_STORAGE_DEQUE.
+         * @note only can be called when queue is empty.
+         */
+        void sizer(std::function<int64_t(const T &)> sizer) {
+            if (sizer && m_storage != DISPATCH_STORAGE_DEQUE) {
+                throw Exception("Byte limits only work with DISPATCH_STORAGE_DEQUE.");
+            }
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (!m_deque.empty() || m_laned != 0) {
+                throw Exception("Can not change sizer of not empty DispatcherQueue.");
+            }
+            m_sizer = std::move(sizer);
+        }
+
+        /**
+         * Limit bytes of values in queue, work like `limit` with current mode.
+         * Value pushed to empty queue is always accepted, even if it is larger than limit.
+         * @param bytes max bytes, 0 means no limit
+         * @note only work after `sizer` set.
+         */
+        void byte_limit(int64_t bytes) {
+            m_byte_limit = bytes;
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            signal(m_push_event, true);
+        }
+
+        int64_t byte_limit() const {
+            return m_byte_limit;
+        }
+
+        /**
+         * Share byte budget with other queues, bytes of values in all queues are limited by budget,
+         * work like `limit` with current mode. Waiting producer is woken by any queue releasing bytes.
+         * Value pushed to empty queue is always accepted, so full budget never stops the last stage.
+         * @param budget shared budget, nullptr for not using
+         * @note only work after `sizer` set.
+         * @note only can be called when queue is empty.
+         */
+        void budget(std::shared_ptr<DispatcherBudget> budget) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (!m_deque.empty() || m_laned != 0) {
+                throw Exception("Can not change budget of not empty DispatcherQueue.");
+            }
+            m_budget = std::move(budget);
+        }
+
+        std::shared_ptr<DispatcherBudget> budget() const {
+            return m_budget;
+        }
+
+        /**
+         * @return bytes of values in queue, 0 if sizer not set
+         */
+        int64_t bytes() const {
+            return m_bytes;
+        }
+
+        /**
+         * @return number of values discarded for ttl or deadline
+         */
+        int64_t expired() const {
+            return m_expired;
+        }
+
+        /**
+         * Stamp values to trace their queue-wait, service time, and latency from origin.
+         * Value pushed by a thread processing traced value inherits its origin, see `DispatcherTrace`,
+         * otherwise its origin is the time pushed.
+         * Times are reported by `set_trace_reporter` after each value processed by binded action.
+         * @param on enable tracing or not
+         * @note values are stamped only with DISPATCH_STORAGE_DEQUE, ring storages do not trace.
+         * @note only can be called before any action binded and when queue is empty.
+         */
+        void trace(bool on) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change tracing of DispatcherQueue after action binded.");
+            }
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            if (!m_deque.empty() || m_laned != 0) {
+                throw Exception("Can not change tracing of not empty DispatcherQueue.");
+            }
+            m_tracing = on;
+            restamp();
+        }
+
+        bool tracing() const {
+            return m_tracing;
+        }
+
+        /**
+         * @param reporter called with queue-wait, service time and latency from origin of each traced value
+         */
+        void set_trace_reporter(const std::function<void(time::us, time::us, time::us)> &reporter) {
+            m_trace_report = reporter;
+        }
+
+        void clear_trace_reporter() {
+            m_trace_report = nullptr;
+        }
+
+        /**
+         * Set which values are timed by time reporter and traced by trace reporter.
+         * Values not sampled are still counted by IO actions.
+         * @param sampling sampling policy, every value by default
+         * @note could be called at any time.
+         */
+        void sampling(const DispatcherSampling &sampling) {
+            m_sampler.policy(sampling);
+        }
+
+        DispatcherSampling sampling() const {
+            return m_sampler.policy();
+        }
+
+        /**
+         * @return number of values discarded by limit and mode of lane
+         */
+        int64_t lane_dropped(size_t index) const {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            return index < m_lanes.size() ? m_lanes[index].dropped : 0;
+        }
+
+        /**
+         * Number values in popped order, start from 0.
+         * Binded action can get the number of processing value by `ticket()`, to restore order of outputs.
+         * @param on enable numbering or not
+         * @note only can be called before any action binded.
+         * @note values discarded by `limit` do not take numbers, so numbers taken by actions are continuous.
+         */
+        void ticketing(bool on) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change ticketing of DispatcherQueue after action binded.");
+            }
+            m_ticketing = on;
+        }
+
+        bool ticketing() const {
+            return m_ticketing;
+        }
+
+        /**
+         * @return number of the value processing by binded action in current thread, -1 if not numbered.
+         */
+        static int64_t ticket() {
+            return Ticket();
+        }
+
         /**
          * Set IO action, action will called when data input or output.
          * @param in_action called after data push
          * @param out_action called after data pop
          * @note only can be called when on data processing
+         * @note actions are called outside of queue lock, except counting values dropped or expired.
          */
         void set_io_action(const std::function<void()> &in_action,
                            const std::function<void()> &out_action) {
-            m_in_action = in_action;
-            m_out_action = out_action;
+            m_in_action = [in_action](int64_t n) { for (int64_t i = 0; i < n; ++i) in_action(); };
+            m_out_action = [out_action](int64_t n) { for (int64_t i = 0; i < n; ++i) out_action(); };
+        }
+
+        /**
+         * Set IO counter, counter will called with number of values when data input or output.
+         * @param in_counter called after data push
+         * @param out_counter called after data pop
+         * @note only can be called when on data processing
+         */
+        void set_io_counter(const std::function<void(int64_t)> &in_counter,
+                            const std::function<void(int64_t)> &out_counter) {
+            m_in_action = in_counter;
+            m_out_action = out_counter;
         }
 
         /**
@@ -228,16 +802,16 @@ namespace ohm {
          * @note only can be called when on data processing
          */
         void clear_io_action() {
-            m_in_action = []() {};
-            m_out_action = []() {};
+            m_in_action = [](int64_t) {};
+            m_out_action = [](int64_t) {};
         }
 
         /**
-         * Set time reporter, it will report each process time to reporter
+         * Set time reporter, it will report each process time to reporter, in nanoseconds
          * @param reporter time reporter
          * @note only can be called when on data processing
          */
-        void set_time_reporter(const std::function<void(time::ms)> &reporter) {
+        void set_time_reporter(const std::function<void(time::ns)> &reporter) {
             m_action_report = reporter;
         }
 
@@ -254,15 +828,128 @@ namespace ohm {
          * @return threads
          */
         size_t threads() {
-            return m_threads.size();
+            if (m_pool) {
+                std::unique_lock<std::mutex> _lock(m_slot_mutex);
+                return std::min(m_slots.size(), m_slot_limit);
+            }
+            auto workers = int64_t(m_workers.load()) - m_retire.load();
+            return workers > 0 ? size_t(workers) : 0;
         }
 
-        void keep_wait() {
-            m_mode = DISPATCH_KEEP_WAIT;
+        /**
+         * Change number of workers while running, new workers run copy of the last binded action.
+         * Extra workers exit after processing their current values.
+         * @param size number of workers, at least 1
+         * @note only for queue with binded actions, not intime action.
+         */
+        void resize(size_t size) {
+            if (size == 0) size = 1;
+            std::unique_lock<std::mutex> _resize_lock(m_resize_mutex);
+            if (m_pool) {
+                Action action;
+                {
+                    std::unique_lock<std::mutex> _lock(m_slot_mutex);
+                    if (m_slots.empty()) throw Exception("Can not resize DispatcherQueue without binded action.");
+                    action = m_slots.back();
+                    m_slot_limit = size;
+                }
+                while (m_slots.size() < size) bind(action);
+                // slots allowed now may be idle with values in queue
+                if (this->size() > 0) {
+                    for (size_t i = 0; i < size; ++i) schedule();
+                }
+                return;
+            }
+            if (m_threads.empty()) throw Exception("Can not resize DispatcherQueue without binded action.");
+            auto action = m_threads.back()->action;
+            prune();
+            auto current = int64_t(m_workers.load()) - m_retire.load();
+            if (int64_t(size) < current) {
+                m_retire += current - int64_t(size);
+                wake_all(m_pop_event);
+                return;
+            }
+            auto more = int64_t(size) - current;
+            // cancel retiring first, workers not exited yet
+            auto retire = m_retire.load();
+            while (retire > 0 && more > 0) {
+                auto cancel = std::min(retire, more);
+                if (m_retire.compare_exchange_weak(retire, retire - cancel)) {
+                    more -= cancel;
+                    break;
+                }
+            }
+            for (int64_t i = 0; i < more; ++i) {
+                ++m_workers;
+                m_threads.emplace_back(std::make_shared<Thread>(action, &self::operating, this, action));
+            }
         }
 
-        void keep_new() {
-            m_mode = DISPATCH_KEEP_NEW;
+        /**
+         * Set how idle workers, `pop` and blocked producers wait.
+         * With DISPATCH_WAIT_SPIN or DISPATCH_WAIT_POLL, wakeup costs no syscall if waiting thread is spinning,
+         * at the cost of CPU time while queue is idle. Use them only for latency critical queues.
+         * Signal is skipped if no thread sleeping, so producer pays no syscall with any policy.
+         * @param policy waiting policy, default is DISPATCH_WAIT_BLOCK
+         * @param spin number of spins before yielding, 0 means default 4096, about several microseconds.
+         * @note pool threads of `executor` always run other tasks instead of spinning.
+         */
+        void waiting(DispatcherWait policy, size_t spin = 0) {
+            m_spin = spin;
+            m_wait = policy;
+            wake_all(m_pop_event);
+            wake_all(m_push_event);
+        }
+
+        DispatcherWait waiting() const {
+            return DispatcherWait(m_wait.load());
+        }
+
+        /**
+         * Set CPU affinity, NUMA node and priority of dedicated worker threads.
+         * Settings not supported on this platform or without privilege are skipped.
+         * @param placement applied in each worker thread, the thread index counts workers started
+         * @note only can be called before any action binded.
+         * @note not applied to shared executor, set placement of `WorkStealingPool` instead.
+         */
+        void placement(ThreadPlacement placement) {
+            if (!m_threads.empty() || !m_slots.empty() || m_intime_action) {
+                throw Exception("Can not change placement of DispatcherQueue after action binded.");
+            }
+            m_placement = std::move(placement);
+        }
+
+        /**
+         * @return placement of dedicated worker threads
+         */
+        const ThreadPlacement &placement() const {
+            return m_placement;
+        }
+
+        /**
+         * @return if any action binded, include intime action
+         */
+        bool binded() const {
+            return !m_threads.empty() || !m_slots.empty() || m_intime_action;
+        }
+
+        /**
+         * @return if intime action binded, `push` calls it directly
+         */
+        bool intime() const {
+            return bool(m_intime_action);
+        }
+
+        DispatcherMode mode() const {
+            return DispatcherMode(m_mode.load());
+        }
+
+        void keep_wait() {
+            m_mode = DISPATCH_KEEP_WAIT;
+        }
+
+        void keep_new() {
+            m_mode = DISPATCH_KEEP_NEW;
         }
 
         void keep_old() {
@@ -273,11 +960,69 @@ namespace ohm {
             m_mode = DISPATCH_FLUSH;
         }
 
+        void mode(DispatcherMode mode) {
+            m_mode = mode;
+        }
+
     private:
         std::deque<T> m_deque;
+
+        /**
+         * One priority lane, only used when lanes set.
+         */
+        struct Stamp {
+            DispatcherTrace::clock::time_point enqueued;
+            DispatcherTrace::clock::time_point origin;      ///< only set when tracing
+        };
+
+        /**
+         * Trace of popped value.
+         */
+        struct Traced {
+            DispatcherTrace::clock::time_point origin;
+            time::us wait;
+        };
+
+        struct Lane {
+            std::deque<std::pair<Stamp, T>> values;
+            int64_t limit = -1;     ///< 0 or negative means using queue limit
+            int32_t mode = -1;      ///< DispatcherMode, negative means using queue mode
+            int64_t wait = 0;       ///< smoothed waiting time in microseconds
+            int64_t dropped = 0;
+        };
+
+        std::vector<Lane> m_lanes;              // empty if values not stamped, guarded by m_mutex
+        size_t m_lane_size;                     // number of lanes set by `lanes`
+        size_t m_laned;                         // number of values in all lanes
+        time::us m_aging;
+        std::function<size_t(const T &)> m_classifier;
+        time::us m_ttl;                         // max waiting time, values stamped in lanes
+        std::function<std::chrono::steady_clock::time_point(const T &)> m_deadline;
+        bool m_has_deadline;
+        std::atomic<int64_t> m_expired;
+        std::function<int64_t(const T &)> m_sizer;  // estimate bytes of value, empty if not counting bytes
+        std::atomic<int64_t> m_bytes;           // bytes of values in queue
+        std::atomic<int64_t> m_byte_limit;
+        std::shared_ptr<DispatcherBudget> m_budget;
+        bool m_tracing;
+        std::function<void(time::us, time::us, time::us)> m_trace_report;
+        DispatcherSampler m_sampler;            // which values timed and traced
         mutable std::mutex m_mutex;
-        std::condition_variable m_cond_push;    // has space to push
-        std::condition_variable m_cond_pop;     // has element to pop
+
+        /**
+         * Threads waiting for one condition.
+         * `epoch` increases on every signal, so spinning threads can watch it without lock.
+         */
+        struct Event {
+            std::condition_variable cond;
+            std::atomic<int> sleepers;      ///< threads sleeping on `cond`, changed with `m_mutex` locked
+            std::atomic<uint64_t> epoch;
+
+            Event() : sleepers(0), epoch(0) {}
+        };
+
+        Event m_push_event;     // has space to push
+        Event m_pop_event;      // has element to pop
         std::vector<std::shared_ptr<Thread>> m_threads;
         std::atomic<bool> m_running;
         Action m_intime_action;
@@ -285,50 +1030,898 @@ namespace ohm {
         std::atomic<int64_t> m_limit;
         std::atomic<int32_t> m_mode;
 
-        std::function<void()> m_in_action;
-        std::function<void()> m_out_action;
+        std::function<void(int64_t)> m_in_action;
+        std::function<void(int64_t)> m_out_action;
+        std::atomic<size_t> m_batch;
 
-        std::function<void(time::ms)> m_action_report;
+        std::function<void(time::ns)> m_action_report;
 
-        struct Reporter {
+        int32_t m_storage;
+        std::unique_ptr<MPMCRingBuffer<T>> m_mpmc;
+        std::unique_ptr<SPSCRingBuffer<T>> m_spsc;
+        std::atomic<int64_t> m_evict;           // values waiting for consumer discarding, only for SPSC
+        std::atomic<int32_t> m_wait;            // DispatcherWait
+        std::atomic<size_t> m_spin;             // spins before yielding, 0 means default
+        std::atomic<size_t> m_placed;           // index of next worker applying placement
+        ThreadPlacement m_placement;            // applied in dedicated threads
+
+        std::atomic<bool> m_closed;
+        std::atomic<bool> m_finished;
+        std::atomic<int> m_workers;             // dedicated threads not exited
+        std::mutex m_resize_mutex;              // serialize resize and clear
+        std::atomic<int64_t> m_retire;          // number of workers should exit
+        std::mutex m_retired_mutex;
+        std::vector<std::thread::id> m_retired; // exited workers not removed from m_threads
+        std::mutex m_finish_mutex;
+        std::vector<std::function<void()>> m_finish_actions;
+
+        bool m_ticketing;
+        std::atomic<int64_t> m_ticket;          // next ticket, taken with value under m_mutex or m_ticket_mutex
+        std::mutex m_ticket_mutex;              // make ring pop and ticket taking atomic
+
+        std::shared_ptr<WorkStealingPool> m_pool;
+        mutable std::mutex m_slot_mutex;
+        std::condition_variable m_slot_cond;    // notified when slot released
+        std::deque<Action> m_slots;             // binded actions on pool, never reallocated
+        size_t m_slot_limit;                    // max slots running at the same time
+        std::vector<size_t> m_free;             // slots not running on pool
+        size_t m_active;                        // slots posted or running on pool
+        std::atomic<size_t> m_idle;             // size of m_free, check it without lock
+
+        /**
+         * Hold one value popped from ring.
+         */
+        class Popped {
         public:
-            Reporter(const std::function<void(time::ms)> &reporter)
-                : m_reporter(reporter), m_start(now()) {
+            Popped() = default;
+
+            ~Popped() { if (m_valid) get().~T(); }
+
+            Popped(const Popped &) = delete;
+
+            Popped &operator=(const Popped &) = delete;
+
+            void operator()(T &&value) {
+                new(&m_memory) T(std::move(value));
+                m_valid = true;
             }
 
-            ~Reporter() {
-                auto end = now();
-                m_reporter(std::chrono::duration_cast<time::ms>(end - m_start));
+            T &get() { return *reinterpret_cast<T *>(&m_memory); }
+
+            void reset() {
+                if (m_valid) get().~T();
+                m_valid = false;
             }
 
         private:
-            std::function<void(time::ms)> m_reporter;
-            time_point m_start;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type m_memory;
+            bool m_valid = false;
         };
 
-        void operating(Action action) {
+        size_t ring_size() const {
+            if (m_mpmc) return m_mpmc->size();
+            if (m_spsc) {
+                auto size = int64_t(m_spsc->size()) - m_evict.load();
+                return size > 0 ? size_t(size) : 0;
+            }
+            return 0;
+        }
+
+        bool ring_full() const {
+            if (m_mpmc) return m_mpmc->size() >= m_mpmc->capacity();
+            if (m_spsc) return m_spsc->size() >= m_spsc->capacity();
+            return false;
+        }
+
+        bool ring_try_pop(Popped &popped) {
             while (true) {
+                if (m_mpmc) {
+                    if (!m_mpmc->try_pop_with(std::ref(popped))) return false;
+                } else {
+                    while (m_evict.load() > 0) {
+                        if (!m_spsc->try_pop_with([](T &&) {})) break;
+                        --m_evict;
+                    }
+                    if (!m_spsc->try_pop_with(std::ref(popped))) return false;
+                }
+                if (!m_has_deadline) return true;
+                if (m_deadline(popped.get()) >= std::chrono::steady_clock::now()) return true;
+                popped.reset();
+                ++m_expired;
+                m_out_action(1);
+            }
+        }
+
+        /**
+         * Busy waiting steps before sleeping, by waiting policy.
+         * DISPATCH_WAIT_BLOCK only yields a little, as a ring can be ready very soon.
+         */
+        SpinWait spinner(bool ring) const {
+            static const size_t default_spin = 4096;
+            auto spin = m_spin.load();
+            if (spin == 0) spin = default_spin;
+            switch (m_wait.load()) {
+                default:
+                    return SpinWait(0, ring ? 64 : 0);
+                case DISPATCH_WAIT_SPIN:
+                    return SpinWait(spin, 64);
+                case DISPATCH_WAIT_POLL:
+                    return SpinWait(spin, 0);
+            }
+        }
+
+        /**
+         * Wait until `ready()` returns true, `ready` is called without lock.
+         * Spin by waiting policy, then park on `event`.
+         */
+        template<typename FUNC>
+        void park(Event &event, FUNC ready) {
+            auto pool = WorkStealingPool::current();
+            if (pool) {
+                // do not block pool thread, run other tasks while waiting
+                while (!ready()) {
+                    if (pool->help()) continue;
+                    std::unique_lock<std::mutex> _lock(m_mutex);
+                    ++event.sleepers;
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (!ready()) event.cond.wait_for(_lock, time::ms(1));
+                    --event.sleepers;
+                }
+                return;
+            }
+            auto spin = spinner(true);
+            while (!ready()) {
+                if (spin.once()) continue;
+                if (m_wait.load() == DISPATCH_WAIT_POLL) {
+                    spin.reset();
+                    continue;
+                }
                 std::unique_lock<std::mutex> _lock(m_mutex);
-                while (true) {
-                    if (!m_running) return;
-                    if (m_deque.empty()) {
-                        m_cond_pop.wait(_lock);
+                ++event.sleepers;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (!ready()) event.cond.wait(_lock);
+                --event.sleepers;
+                return;
+            }
+        }
+
+        /**
+         * Wait for one signal of `event`, `lock` must hold `m_mutex`, caller checks condition again after return.
+         * Spinning releases lock and only watches `event.epoch`.
+         */
+        void idle(std::unique_lock<std::mutex> &lock, Event &event) {
+            if (m_wait.load() != DISPATCH_WAIT_BLOCK) {
+                auto epoch = event.epoch.load();
+                auto spin = spinner(false);
+                lock.unlock();
+                bool signaled = false;
+                while (!(signaled = event.epoch.load() != epoch)) {
+                    if (spin.once()) continue;
+                    if (m_wait.load() != DISPATCH_WAIT_POLL) break;
+                    spin.reset();
+                }
+                lock.lock();
+                // signal between last check and locking was skipped for no sleeper
+                if (signaled || event.epoch.load() != epoch) return;
+            }
+            ++event.sleepers;
+            event.cond.wait(lock);
+            --event.sleepers;
+        }
+
+        /**
+         * Signal `event` with `m_mutex` locked, skip notifying if no thread sleeping.
+         */
+        void signal(Event &event, bool all) {
+            ++event.epoch;
+            if (event.sleepers.load() == 0) return;
+            if (all) {
+                event.cond.notify_all();
+            } else {
+                event.cond.notify_one();
+            }
+        }
+
+        /**
+         * Notify parked thread without `m_mutex` locked, skip lock and notify if there is no sleeper.
+         */
+        void wake(Event &event) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (event.sleepers.load() == 0) return;
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            event.cond.notify_one();
+        }
+
+        void wake_all(Event &event) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            ++event.epoch;
+            event.cond.notify_all();
+        }
+
+        void ring_push(T &data, int32_t mode) {
+            while (true) {
+                auto limit = m_limit.load();
+                if (limit <= 0 || int64_t(ring_size()) < limit) {
+                    if (m_mpmc ? m_mpmc->try_push(data) : m_spsc->try_push(data)) break;
+                    // ring is full, SPSC producer can not discard oldest value by itself.
+                    if (mode == DISPATCH_KEEP_NEW && m_spsc) return;
+                }
+                if (mode == DISPATCH_KEEP_WAIT) {
+                    park(m_push_event, [&]() {
+                        auto limit = m_limit.load();
+                        return (limit <= 0 || int64_t(ring_size()) < limit) && !ring_full();
+                    });
+                    mode = m_mode.load();
+                } else if (mode == DISPATCH_KEEP_NEW) {
+                    if (m_mpmc) {
+                        m_mpmc->try_pop_with([](T &&) {});
                     } else {
-                        break;
+                        auto size = int64_t(ring_size());
+                        if (limit > 0 && size >= limit) m_evict += size - limit + 1;
+                    }
+                } else {
+                    return;
+                }
+            }
+            wake(m_pop_event);
+            m_in_action(1);
+            schedule();
+        }
+
+        /**
+         * Wait until one value popped or queue stopped.
+         * @return false if queue stopped
+         */
+        bool ring_wait_pop(Popped &popped, bool worker = false) {
+            bool got = false;
+            park(m_pop_event, [&]() {
+                if (!m_running) return true;
+                if (worker && m_retire.load() > 0 && retire()) return true;
+                got = ring_try_pop(popped);
+                // no value will come after closed
+                return got || m_closed;
+            });
+            if (!got) return false;
+            wake(m_push_event);
+            return true;
+        }
+
+        /**
+         * Pop at most `max` values after first one popped, without waiting.
+         * @return false if queue stopped
+         */
+        bool ring_wait_pop_bulk(std::vector<T> &values, size_t max, bool worker = false) {
+            Popped first;
+            if (!ring_wait_pop(first, worker)) return false;
+            values.push_back(std::move(first.get()));
+            while (values.size() < max) {
+                Popped popped;
+                if (!ring_try_pop(popped)) break;
+                values.push_back(std::move(popped.get()));
+            }
+            if (values.size() > 1) wake(m_push_event);
+            return true;
+        }
+
+        /**
+         * Wait until queue has space for one more value, `m_mutex` must be locked.
+         * @param lock locked `m_mutex`
+         * @param mode dispatch mode, updated after waiting
+         * @param pending number of values pushed but not notified, will be notified before waiting
+         * @param lane lane of the value, limit and mode of lane are used if set
+         * @return false if the value should be discarded
+         */
+        bool deque_reserve(std::unique_lock<std::mutex> &lock, int32_t &mode, int64_t &pending,
+                           size_t lane = 0, int64_t bytes = 0) {
+            if (!m_lanes.empty()) return lane_reserve(lock, mode, pending, lane, bytes);
+            while (true) {
+                if (mode == DISPATCH_FLUSH) return false;
+                auto limit = m_limit.load();
+                auto full = limit > 0 && int64_t(m_deque.size()) >= limit;
+                if (!full && !bytes_over(bytes)) {
+                    return true;
+                }
+                if (mode == DISPATCH_KEEP_WAIT) {
+                    if (pending) {
+                        signal(m_pop_event, true);
+                        m_in_action(pending);
+                        pending = 0;
+                    }
+                    wait_bytes(lock, full, bytes);
+                    mode = m_mode.load();
+                } else if (mode == DISPATCH_KEEP_NEW) {
+                    int64_t dropped = 0;
+                    while (!m_deque.empty() &&
+                           ((limit > 0 && int64_t(m_deque.size()) >= limit) || bytes_over(bytes))) {
+                        bytes_out(m_deque.front());
+                        m_deque.pop_front();
+                        ++dropped;
+                    }
+                    if (dropped) m_out_action(dropped);
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+
+        /**
+         * @param bytes bytes of pushing value
+         * @return if pushing value exceeds byte limit or budget, value pushed to empty queue never exceeds.
+         */
+        bool bytes_over(int64_t bytes) const {
+            if (!m_sizer || deque_empty()) return false;
+            auto limit = m_byte_limit.load();
+            if (limit > 0 && m_bytes.load() + bytes > limit) return true;
+            return m_budget && m_budget->over(bytes);
+        }
+
+        /**
+         * Wait for space, on this queue if queue itself `full` or exceeds byte limit, or on shared budget.
+         */
+        void wait_bytes(std::unique_lock<std::mutex> &lock, bool full, int64_t bytes) {
+            auto limit = m_byte_limit.load();
+            if (full || !m_budget || (limit > 0 && m_bytes.load() + bytes > limit)) {
+                wait_space(lock);
+                return;
+            }
+            lock.unlock();
+            m_budget->wait(bytes, time::ms(10));
+            lock.lock();
+        }
+
+        int64_t bytes_of(const T &data) const {
+            return m_sizer ? m_sizer(data) : 0;
+        }
+
+        void bytes_in(int64_t bytes) {
+            if (!m_sizer) return;
+            m_bytes += bytes;
+            if (m_budget) m_budget->acquire(bytes);
+        }
+
+        /**
+         * Release bytes of value leaving queue, `m_mutex` must be locked.
+         */
+        void bytes_out(const T &data) {
+            if (!m_sizer) return;
+            auto bytes = m_sizer(data);
+            m_bytes -= bytes;
+            if (m_budget) m_budget->release(bytes);
+        }
+
+        bool lane_reserve(std::unique_lock<std::mutex> &lock, int32_t &mode, int64_t &pending,
+                          size_t lane, int64_t bytes) {
+            while (true) {
+                if (mode == DISPATCH_FLUSH) return false;
+                auto &target = m_lanes[lane];
+                auto limit = target.limit > 0 ? target.limit : m_limit.load();
+                auto lane_mode = target.mode >= 0 ? target.mode : mode;
+                if (lane_mode == DISPATCH_FLUSH) {
+                    ++target.dropped;
+                    return false;
+                }
+                auto full = limit > 0 && int64_t(target.values.size()) >= limit;
+                if (!full && !bytes_over(bytes)) {
+                    return true;
+                }
+                if (lane_mode == DISPATCH_KEEP_WAIT) {
+                    if (pending) {
+                        signal(m_pop_event, true);
+                        m_in_action(pending);
+                        pending = 0;
+                    }
+                    wait_bytes(lock, full, bytes);
+                    mode = m_mode.load();
+                } else if (lane_mode == DISPATCH_KEEP_NEW) {
+                    int64_t dropped = 0;
+                    // drop oldest values of the same lane only, values of other lanes are kept
+                    while (!target.values.empty() &&
+                           ((limit > 0 && int64_t(target.values.size()) >= limit) || bytes_over(bytes))) {
+                        bytes_out(target.values.front().second);
+                        target.values.pop_front();
+                        ++target.dropped;
+                        --m_laned;
+                        ++dropped;
+                    }
+                    m_out_action(dropped);
+                    return true;
+                } else {
+                    ++target.dropped;
+                    return false;
+                }
+            }
+        }
+
+        static const size_t unclassified = size_t(-1);
+
+        void push_to(T &data, size_t lane) {
+            if (m_closed) throw Exception("Can not push to closed DispatcherQueue.");
+            auto mode = m_mode.load();
+            if (mode == DISPATCH_FLUSH) {
+                return;
+            }
+            if (m_intime_action) {
+                run_intime(std::move(data));
+                return;
+            }
+            if (m_storage != DISPATCH_STORAGE_DEQUE) {
+                ring_push(data, mode);
+                return;
+            }
+            auto bytes = bytes_of(data);
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            int64_t pending = 0;
+            lane = lane == unclassified ? classify(data) : clamp_lane(lane);
+            if (!deque_reserve(_lock, mode, pending, lane, bytes)) return;
+            deque_put(std::move(data), lane, bytes);
+            signal(m_pop_event, false);
+            _lock.unlock();
+            m_in_action(1);
+            schedule();
+        }
+
+        size_t clamp_lane(size_t lane) const {
+            if (m_lanes.empty()) return 0;
+            return lane < m_lanes.size() ? lane : m_lanes.size() - 1;
+        }
+
+        /**
+         * @return lane of value by classifier, `m_mutex` must be locked.
+         */
+        size_t classify(const T &data) const {
+            if (m_lanes.empty()) return 0;
+            return clamp_lane(m_classifier ? m_classifier(data) : m_lanes.size() - 1);
+        }
+
+        bool deque_empty() const {
+            return m_lanes.empty() ? m_deque.empty() : m_laned == 0;
+        }
+
+        size_t deque_size() const {
+            return m_lanes.empty() ? m_deque.size() : m_laned;
+        }
+
+        /**
+         * Put value to deque or lane, `m_mutex` must be locked.
+         */
+        void deque_put(T data, size_t lane, int64_t bytes = 0) {
+            bytes_in(bytes);
+            if (m_lanes.empty()) {
+                m_deque.push_back(std::move(data));
+                return;
+            }
+            Stamp stamp;
+            stamp.enqueued = DispatcherTrace::clock::now();
+            if (m_tracing) {
+                stamp.origin = DispatcherTrace::origin();
+                if (stamp.origin == DispatcherTrace::clock::time_point()) stamp.origin = stamp.enqueued;
+            }
+            m_lanes[lane].values.emplace_back(stamp, std::move(data));
+            ++m_laned;
+        }
+
+        /**
+         * Keep lanes if values need stamps, for priority, ttl or tracing, `m_mutex` must be locked.
+         */
+        void restamp() {
+            size_t size = m_lane_size > 1 ? m_lane_size : (m_ttl.count() > 0 || m_tracing) ? 1 : 0;
+            if (m_storage != DISPATCH_STORAGE_DEQUE) size = 0;
+            if (size != m_lanes.size()) m_lanes = std::vector<Lane>(size);
+        }
+
+        /**
+         * Discard expired values at front of deque and each lane, `m_mutex` must be locked.
+         * Values behind front are checked when they come to front, before taken.
+         */
+        void deque_expire() {
+            if (m_ttl.count() <= 0 && !m_has_deadline) return;
+            int64_t expired = 0;
+            auto now = std::chrono::steady_clock::now();    // deadlines are of steady_clock
+            auto stamp_now = DispatcherTrace::clock::now();
+            if (m_lanes.empty()) {
+                while (!m_deque.empty() && m_deadline(m_deque.front()) < now) {
+                    bytes_out(m_deque.front());
+                    m_deque.pop_front();
+                    ++expired;
+                }
+            } else {
+                for (auto &lane : m_lanes) {
+                    auto &values = lane.values;
+                    while (!values.empty() &&
+                           ((m_ttl.count() > 0 && stamp_now - values.front().first.enqueued > m_ttl) ||
+                            (m_has_deadline && m_deadline(values.front().second) < now))) {
+                        bytes_out(values.front().second);
+                        values.pop_front();
+                        --m_laned;
+                        ++expired;
                     }
                 }
-                if (!m_running) break;
-                auto tmp = m_deque.front();
+            }
+            if (expired == 0) return;
+            m_expired += expired;
+            m_out_action(expired);
+            signal(m_push_event, true);
+        }
+
+        /**
+         * Take the front value of deque, or of the highest lane unless a lower lane aged.
+         * `m_mutex` must be locked and deque not empty.
+         */
+        T deque_take(std::vector<Traced> *traces = nullptr) {
+            if (m_lanes.empty()) {
+                bytes_out(m_deque.front());
+                auto tmp = std::move(m_deque.front());
                 m_deque.pop_front();
-                m_cond_push.notify_one();
-                m_out_action();
+                return tmp;
+            }
+            auto now = DispatcherTrace::clock::now();
+            size_t pick = m_lanes.size();
+            for (size_t i = 0; i < m_lanes.size(); ++i) {
+                auto &values = m_lanes[i].values;
+                if (values.empty()) continue;
+                if (pick == m_lanes.size()) {
+                    pick = i;
+                    if (m_aging.count() <= 0) break;
+                    continue;
+                }
+                auto stamp = values.front().first.enqueued;
+                if (now - stamp >= m_aging && stamp < m_lanes[pick].values.front().first.enqueued) pick = i;
+            }
+            auto &lane = m_lanes[pick];
+            auto &stamp = lane.values.front().first;
+            auto wait = std::chrono::duration_cast<time::us>(now - stamp.enqueued);
+            lane.wait += (wait.count() - lane.wait) / 8;
+            if (traces && m_tracing) traces->push_back({stamp.origin, wait});
+            bytes_out(lane.values.front().second);
+            auto tmp = std::move(lane.values.front().second);
+            lane.values.pop_front();
+            --m_laned;
+            return tmp;
+        }
+
+        /**
+         * Wait for `m_push_event`, pool thread runs other tasks instead of blocking.
+         */
+        void wait_space(std::unique_lock<std::mutex> &lock) {
+            auto pool = WorkStealingPool::current();
+            if (!pool) {
+                idle(lock, m_push_event);
+                return;
+            }
+            lock.unlock();
+            bool helped = pool->help();
+            lock.lock();
+            if (helped) return;
+            ++m_push_event.sleepers;
+            m_push_event.cond.wait_for(lock, time::ms(1));
+            --m_push_event.sleepers;
+        }
+
+        /**
+         * Post one idle slot to pool if there are values in queue.
+         */
+        void schedule() {
+            if (!m_pool || m_idle.load() == 0) return;
+            size_t slot;
+            {
+                std::unique_lock<std::mutex> _lock(m_slot_mutex);
+                if (m_free.empty() || !m_running || m_active >= m_slot_limit) return;
+                slot = m_free.back();
+                m_free.pop_back();
+                --m_idle;
+                ++m_active;
+            }
+            m_pool->post([this, slot]() { drain(slot); });
+        }
+
+        /**
+         * Run on pool, process values until queue empty.
+         * After a quantum of values, the slot is posted again to let other tasks run.
+         * @param slot index of binded action
+         */
+        void drain(size_t slot) {
+            static const int64_t quantum = 64;
+            auto &action = m_slots[slot];
+            std::vector<T> batch;
+            std::vector<Traced> traces;
+            int64_t done = 0;
+            while (m_running) {
+                auto max = m_batch.load();
+                int64_t ticket = -1;
+                if (m_storage != DISPATCH_STORAGE_DEQUE) {
+                    std::unique_lock<std::mutex> _ticket_lock(m_ticket_mutex, std::defer_lock);
+                    if (m_ticketing) _ticket_lock.lock();
+                    while (batch.size() < max) {
+                        Popped popped;
+                        if (!ring_try_pop(popped)) break;
+                        batch.push_back(std::move(popped.get()));
+                    }
+                    if (batch.empty()) break;
+                    if (m_ticketing) ticket = m_ticket.fetch_add(int64_t(batch.size()));
+                    _ticket_lock = std::unique_lock<std::mutex>();
+                    wake(m_push_event);
+                } else {
+                    std::unique_lock<std::mutex> _lock(m_mutex);
+                    deque_expire();
+                    if (deque_empty()) break;
+                    while (batch.size() < max && !deque_empty()) {
+                        batch.push_back(deque_take(&traces));
+                        deque_expire();
+                    }
+                    if (m_ticketing) ticket = m_ticket.fetch_add(int64_t(batch.size()));
+                    signal(m_push_event, batch.size() > 1);
+                }
+                m_out_action(int64_t(batch.size()));
+                run_batch(action, batch, ticket, traces);
+                done += int64_t(batch.size());
+                batch.clear();
+                traces.clear();
+                if (done >= quantum) {
+                    m_pool->post([this, slot]() { drain(slot); });
+                    return;
+                }
+            }
+            {
+                std::unique_lock<std::mutex> _lock(m_slot_mutex);
+                m_free.push_back(slot);
+                ++m_idle;
+                --m_active;
+                m_slot_cond.notify_all();
+            }
+            // value may come after queue found empty and before slot released.
+            if (m_running && size() > 0) {
+                schedule();
+            } else if (m_closed) {
+                finish_if_drained();
+            }
+        }
+
+        /**
+         * Finish closed queue running on pool, if no value left and no slot running.
+         */
+        void finish_if_drained() {
+            {
+                std::unique_lock<std::mutex> _lock(m_slot_mutex);
+                if (m_active > 0) return;
+            }
+            if (size() == 0) finish();
+        }
+
+        /**
+         * Mark finished and call finish actions, only the first call works.
+         */
+        void finish() {
+            if (m_finished.exchange(true)) return;
+            std::vector<std::function<void()>> actions;
+            {
+                std::unique_lock<std::mutex> _lock(m_finish_mutex);
+                actions.swap(m_finish_actions);
+            }
+            for (auto &action : actions) action();
+        }
+
+        /**
+         * Wait until queue has value, and pop at most `max` values, `m_mutex` must be locked.
+         * @return false if queue stopped
+         */
+        bool deque_wait_pop_bulk(std::unique_lock<std::mutex> &lock, std::vector<T> &values, size_t max,
+                                 bool worker = false, std::vector<Traced> *traces = nullptr) {
+            while (true) {
+                if (!m_running) return false;
+                if (worker && m_retire.load() > 0 && retire()) return false;
+                deque_expire();
+                if (deque_empty()) {
+                    if (m_closed) return false;
+                    idle(lock, m_pop_event);
+                } else {
+                    break;
+                }
+            }
+            while (values.size() < max && !deque_empty()) {
+                values.push_back(deque_take(traces));
+                deque_expire();
+            }
+            signal(m_push_event, values.size() > 1);
+            return true;
+        }
+
+        /**
+         * Report time of action, excluding time of timed actions called inside, see `DispatcherTrace::nested`.
+         */
+        struct Reporter {
+        public:
+            Reporter(const std::function<void(time::ns)> &reporter,
+                     DispatcherTrace::clock::duration *exclusive = nullptr)
+                : m_reporter(reporter), m_exclusive(exclusive), m_start(DispatcherTrace::clock::now()),
+                  m_outer(DispatcherTrace::nested()) {
+                DispatcherTrace::nested() = DispatcherTrace::clock::duration(0);
+            }
+
+            ~Reporter() {
+                auto elapsed = DispatcherTrace::clock::now() - m_start;
+                auto &nested = DispatcherTrace::nested();
+                auto exclusive = elapsed - nested;
+                nested = m_outer + elapsed;
+                if (m_exclusive) *m_exclusive = exclusive;
+                if (m_reporter) m_reporter(std::chrono::duration_cast<time::ns>(exclusive));
+            }
+
+        private:
+            const std::function<void(time::ns)> &m_reporter;     ///< not copied, copying per value is costly
+            DispatcherTrace::clock::duration *m_exclusive;
+            DispatcherTrace::clock::time_point m_start;
+            DispatcherTrace::clock::duration m_outer;
+        };
+
+        void operating(Action action) {
+            if (!m_placement.empty()) m_placement.apply(m_placed++);
+            if (m_storage != DISPATCH_STORAGE_DEQUE) {
+                ring_operating(action);
+            } else {
+                deque_operating(action);
+            }
+            if (m_running) {
+                std::unique_lock<std::mutex> _lock(m_retired_mutex);
+                m_retired.push_back(std::this_thread::get_id());
+            }
+            // the last exiting worker has processed all values
+            if (--m_workers == 0 && m_closed) finish();
+        }
+
+        /**
+         * Take one retire request.
+         * @return true if current worker should exit
+         */
+        bool retire() {
+            auto retire = m_retire.load();
+            while (retire > 0) {
+                if (m_retire.compare_exchange_weak(retire, retire - 1)) return true;
+            }
+            return false;
+        }
+
+        /**
+         * Remove exited workers, `m_resize_mutex` must be locked.
+         */
+        void prune() {
+            std::vector<std::thread::id> retired;
+            {
+                std::unique_lock<std::mutex> _lock(m_retired_mutex);
+                retired.swap(m_retired);
+            }
+            for (auto &id : retired) {
+                for (auto it = m_threads.begin(); it != m_threads.end(); ++it) {
+                    if ((*it)->thread.get_id() == id) {
+                        m_threads.erase(it);    // joined in destructor
+                        break;
+                    }
+                }
+            }
+        }
+
+        void deque_operating(Action &action) {
+            std::vector<T> batch;
+            std::vector<Traced> traces;
+            while (true) {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                if (!deque_wait_pop_bulk(_lock, batch, m_batch, true, &traces)) return;
+                auto ticket = m_ticketing ? m_ticket.fetch_add(int64_t(batch.size())) : int64_t(-1);
                 _lock.unlock();
-                if (m_action_report) {
-                    Reporter reporter(m_action_report);
-                    action(tmp);
+                m_out_action(int64_t(batch.size()));
+                run_batch(action, batch, ticket, traces);
+                batch.clear();
+                traces.clear();
+            }
+        }
+
+        void ring_operating(Action &action) {
+            std::vector<T> batch;
+            while (true) {
+                int64_t ticket = -1;
+                if (m_ticketing) {
+                    // only one worker waits for value, others wait for the ticket lock
+                    std::unique_lock<std::mutex> _ticket_lock(m_ticket_mutex);
+                    if (!ring_wait_pop_bulk(batch, m_batch, true)) return;
+                    ticket = m_ticket.fetch_add(int64_t(batch.size()));
                 } else {
-                    action(tmp);
+                    if (!ring_wait_pop_bulk(batch, m_batch, true)) return;
+                }
+                m_out_action(int64_t(batch.size()));
+                run_batch(action, batch, ticket);
+                batch.clear();
+            }
+        }
+
+        /**
+         * Run each value in batch, values are numbered from `ticket` if it is not -1.
+         */
+        void run_batch(Action &action, std::vector<T> &batch, int64_t ticket) {
+            if (ticket < 0) {
+                for (auto &tmp : batch) {
+                    run(action, std::move(tmp));
+                }
+                return;
+            }
+            auto &current = Ticket();
+            auto outer = current;   // pool thread may run action of other queue while helping
+            for (auto &tmp : batch) {
+                current = ticket++;
+                run(action, std::move(tmp));
+            }
+            current = outer;
+        }
+
+        /**
+         * Run batch with trace of each value, values pushed in action inherit the origin.
+         */
+        void run_batch(Action &action, std::vector<T> &batch, int64_t ticket, const std::vector<Traced> &traces) {
+            if (traces.size() != batch.size()) {
+                run_batch(action, batch, ticket);
+                return;
+            }
+            auto &current = Ticket();
+            auto &origin = DispatcherTrace::origin();
+            auto outer = current;
+            auto outer_origin = origin;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (ticket >= 0) current = ticket++;
+                origin = traces[i].origin;
+                if (!m_sampler.sample()) {
+                    action(std::move(batch[i]));
+                    continue;
                 }
+                DispatcherTrace::clock::duration service(0);
+                run(action, std::move(batch[i]), &service);
+                if (!m_trace_report) continue;
+                auto end = DispatcherTrace::clock::now();
+                m_trace_report(traces[i].wait,
+                       std::chrono::duration_cast<time::us>(service),
+                       std::chrono::duration_cast<time::us>(end - traces[i].origin));
+            }
+            current = outer;
+            origin = outer_origin;
+        }
+
+        static int64_t &Ticket() {
+            static thread_local int64_t ticket = -1;
+            return ticket;
+        }
+
+        /**
+         * Run intime action in pushing thread, counted and timed like value processed by workers.
+         */
+        void run_intime(T data) {
+            m_in_action(1);
+            m_out_action(1);
+            if (!m_trace_report) {
+                run(m_intime_action, std::move(data));
+                return;
+            }
+            if (!m_sampler.sample()) {
+                m_intime_action(std::move(data));
+                return;
+            }
+            DispatcherTrace::clock::duration service(0);
+            run(m_intime_action, std::move(data), &service);
+            auto origin = DispatcherTrace::origin();
+            if (origin == DispatcherTrace::clock::time_point()) return;     // not pushed by traced worker
+            auto end = DispatcherTrace::clock::now();
+            m_trace_report(time::us(0),
+                           std::chrono::duration_cast<time::us>(service),
+                           std::chrono::duration_cast<time::us>(end - origin));
+        }
+
+        /**
+         * Run action, timed if sampled.
+         * @param exclusive set to time of action excluding nested timed actions, if not nullptr, always timed.
+         */
+        void run(Action &action, T data, DispatcherTrace::clock::duration *exclusive = nullptr) {
+            if (exclusive || (m_action_report && m_sampler.sample())) {
+                Reporter reporter(m_action_report, exclusive);
+                action(std::move(data));
+            } else {
+                action(std::move(data));
             }
         }
     };
@@ -338,7 +1931,7 @@ namespace ohm {
         std::shared_ptr<std::mutex> pmutex(new std::mutex);
         return [pmutex, func](ARGS... args) -> RET{
             std::unique_lock<std::mutex> _lock(*pmutex);
-            return func(args...);
+            return func(std::forward<ARGS>(args)...);
         };
     }
 
@@ -347,7 +1940,7 @@ namespace ohm {
         std::shared_ptr<std::mutex> pmutex(new std::mutex);
         return [pmutex, func](ARGS... args) -> void{
             std::unique_lock<std::mutex> _lock(*pmutex);
-            func(args...);
+            func(std::forward<ARGS>(args)...);
         };
     }
 
@@ -0,0 +1,171 @@
+//
+// Created by kier on 2020/12/19.
+//
+
+#ifndef OMEGA_DISPATCHER_SAMPLER_H
+#define OMEGA_DISPATCHER_SAMPLER_H
+
+#include "sharded_counter.h"
+#include "../clock.h"
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace ohm {
+    /**
+     * Which values are timed and traced, values not sampled are still counted.
+     * Usage:
+     * ```
+     * pipe.profile("detect", ohm::DispatcherSampling::OneIn(100));
+     * pipe.profile("decode", ohm::DispatcherSampling::PerSecond(1000));
+     * ```
+     */
+    struct DispatcherSampling {
+        enum Mode {
+            EVERY,          // every value
+            ONE_IN,         // one value in every `n` values
+            PER_SECOND,     // about `rate` values each second, spread evenly
+        };
+
+        Mode mode = EVERY;
+        int64_t n = 1;
+        double rate = 0;
+
+        static DispatcherSampling Every() {
+            return DispatcherSampling();
+        }
+
+        /**
+         * @param n 1 means every value
+         */
+        static DispatcherSampling OneIn(int64_t n) {
+            DispatcherSampling sampling;
+            sampling.mode = n > 1 ? ONE_IN : EVERY;
+            sampling.n = n > 1 ? n : 1;
+            return sampling;
+        }
+
+        /**
+         * @param rate samples each second
+         */
+        static DispatcherSampling PerSecond(double rate) {
+            DispatcherSampling sampling;
+            sampling.mode = rate > 0 ? PER_SECOND : EVERY;
+            sampling.rate = rate;
+            return sampling;
+        }
+    };
+
+    /**
+     * Decide which values sampled, by `DispatcherSampling` which could be changed at any time.
+     * Each thread counts values on its own shard, so deciding is one relaxed add without contention.
+     * Sampling per second adapts the stride once each window, by rate of samples taken in it.
+     */
+    class DispatcherSampler {
+    public:
+        using self = DispatcherSampler;
+        using clock = MonotonicClock;
+
+        DispatcherSampler()
+                : m_mode(DispatcherSampling::EVERY), m_stride(1), m_rate(0), m_samples(0), m_window(0) {
+            for (auto &shard : m_shards) shard.seen.store(0, std::memory_order_relaxed);
+        }
+
+        DispatcherSampler(const DispatcherSampler &) = delete;
+
+        DispatcherSampler &operator=(const DispatcherSampler &) = delete;
+
+        void policy(const DispatcherSampling &sampling) {
+            std::unique_lock<std::mutex> _lock(m_mutex);
+            m_rate = sampling.rate;
+            // sampling per second starts from every value, the first window finds the stride
+            m_stride = sampling.mode == DispatcherSampling::ONE_IN ? sampling.n : 1;
+            m_samples = 0;
+            m_window = 0;
+            m_mode = sampling.mode;
+        }
+
+        DispatcherSampling policy() const {
+            switch (m_mode.load()) {
+                default:
+                    return DispatcherSampling::Every();
+                case DispatcherSampling::ONE_IN:
+                    return DispatcherSampling::OneIn(m_stride.load());
+                case DispatcherSampling::PER_SECOND:
+                    return DispatcherSampling::PerSecond(m_rate.load());
+            }
+        }
+
+        /**
+         * @return current stride, one value in each `stride` values sampled
+         */
+        int64_t stride() const {
+            return m_stride.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Called once for each value.
+         * @return if the value should be sampled
+         */
+        bool sample() {
+            auto mode = m_mode.load(std::memory_order_relaxed);
+            if (mode == DispatcherSampling::EVERY) return true;
+            auto stride = m_stride.load(std::memory_order_relaxed);
+            auto &shard = m_shards[ShardedCounter::Shard() % Size];
+            auto seen = shard.seen.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (seen % stride != 0) return false;
+            if (mode == DispatcherSampling::PER_SECOND) adapt();
+            return true;
+        }
+
+    private:
+        static const size_t Size = 16;
+
+        struct Cell {
+            std::atomic<int64_t> seen;
+            char padding[64 - sizeof(std::atomic<int64_t>)];
+        };
+
+        Cell m_shards[Size];
+        std::atomic<int> m_mode;
+        std::atomic<int64_t> m_stride;
+        std::atomic<double> m_rate;
+
+        std::mutex m_mutex;                 ///< guards window below, sampling thread skips if locked
+        int64_t m_samples;                  ///< samples taken in current window
+        int64_t m_window;                   ///< start of current window in clock ticks, 0 if not started
+
+        /**
+         * Count one sample, and reset stride at end of window, only sampled values read clock.
+         */
+        void adapt() {
+            std::unique_lock<std::mutex> _lock(m_mutex, std::try_to_lock);
+            if (!_lock.owns_lock()) return;
+            auto now = clock::now().time_since_epoch().count();
+            if (m_window == 0) {
+                m_window = now;
+                m_samples = 0;
+                return;
+            }
+            ++m_samples;
+            auto elapsed = std::chrono::duration<double>(clock::duration(now - m_window)).count();
+            // window ends with many samples, or after 0.1 second with enough samples, or after 1 second
+            if (m_samples < 1024 && elapsed < (m_samples >= 16 ? 0.1 : 1.0)) return;
+            auto rate = m_rate.load();
+            if (rate <= 0) return;
+            auto stride = double(m_stride.load());
+            auto next = stride * (double(m_samples) / elapsed) / rate;
+            // change at most 64 times each window, rates of one window may be noisy
+            if (next > stride * 64) next = stride * 64;
+            if (next < stride / 64) next = stride / 64;
+            m_stride = next < 1 ? 1 : int64_t(next + 0.5);
+            m_window = now;
+            m_samples = 0;
+        }
+    };
+}
+
+#endif //OMEGA_DISPATCHER_SAMPLER_H
@@ -158,7 +158,7 @@ namespace ohm {
         std::atomic<int> m_status;
         std::atomic<FPS::Type> m_fps;
 
-        time_point m_last_tick;
+        steady_point m_last_tick;
 
         struct {
             void lock() {}
@@ -197,7 +197,7 @@ namespace ohm {
         }
 
         void delay() {
-            auto now_tick = now();
+            auto now_tick = steady_now();
             FPS::Type fps = m_fps;
             if (fps == 0) {
                 m_last_tick = now_tick; // still save last tick
@@ -205,7 +205,7 @@ namespace ohm {
             }
             auto wait_until = m_last_tick + time::us(int64_t(1000000.00 / fps));
             m_last_tick = now_tick > wait_until ? now_tick : wait_until;
-            std::this_thread::sleep_until(wait_until);
+            if (wait_until > now_tick) std::this_thread::sleep_for(wait_until - now_tick);
         }
     };
 }
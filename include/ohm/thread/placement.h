@@ -0,0 +1,235 @@
+//
+// Created by kier on 2020/12/16.
+//
+
+#ifndef OMEGA_THREAD_PLACEMENT_H
+#define OMEGA_THREAD_PLACEMENT_H
+
+#include "../platform.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+#if OHM_PLATFORM_OS_WINDOWS
+#include "../sys/windows.h"
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+#if OHM_PLATFORM_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+namespace ohm {
+    /**
+     * Where and how worker threads run: CPU set, preferred NUMA node, and scheduling priority.
+     * Settings not supported by platform or permission are skipped, `apply` tells which ones.
+     * Usage:
+     * ```
+     * auto placement = ThreadPlacement().numa(1).spread().fifo(10);
+     * ```
+     */
+    class ThreadPlacement {
+    public:
+        using self = ThreadPlacement;
+
+        enum Setting {
+            AFFINITY = 1,
+            NUMA = 2,
+            FIFO = 4,
+            NICE = 8,
+        };
+
+        /**
+         * Run workers only on given CPUs.
+         * @param cpus CPU indices
+         * @return self
+         */
+        self &cpus(std::vector<int> cpus) {
+            m_cpus = std::move(cpus);
+            return *this;
+        }
+
+        /**
+         * Run workers on CPUs of NUMA node `node`, and allocate memory from it first.
+         * If `cpus` also set, only CPUs in both are used.
+         * @param node NUMA node index, -1 means no preference.
+         * @return self
+         */
+        self &numa(int node) {
+            m_node = node;
+            return *this;
+        }
+
+        /**
+         * Pin each worker to one CPU of the set, by worker index, instead of the whole set.
+         * @return self
+         */
+        self &spread(bool on = true) {
+            m_spread = on;
+            return *this;
+        }
+
+        /**
+         * Run workers by real-time SCHED_FIFO policy, usually needs privilege.
+         * @param priority priority of SCHED_FIFO, 0 means not using SCHED_FIFO.
+         * @return self
+         */
+        self &fifo(int priority) {
+            m_fifo = priority;
+            return *this;
+        }
+
+        /**
+         * Set nice value of workers, in [-20, 19], negative values usually need privilege.
+         * @return self
+         */
+        self &nice(int nice) {
+            m_nice = nice;
+            m_has_nice = true;
+            return *this;
+        }
+
+        /**
+         * @return if nothing set
+         */
+        bool empty() const {
+            return m_cpus.empty() && m_node < 0 && m_fifo <= 0 && !m_has_nice;
+        }
+
+        /**
+         * Apply to current thread.
+         * @param index worker index, used to select CPU if `spread` set.
+         * @return settings skipped, bits of `Setting`, 0 if all applied.
+         */
+        int apply(size_t index = 0) const {
+            int skipped = 0;
+            auto cpus = this->cpus();
+            if (m_spread && !cpus.empty()) cpus = {cpus[index % cpus.size()]};
+            if (!cpus.empty() && !set_affinity(cpus)) skipped |= AFFINITY;
+            if (m_node >= 0 && !prefer_node(m_node)) skipped |= NUMA;
+            if (m_fifo > 0 && !set_fifo(m_fifo)) skipped |= FIFO;
+            if (m_has_nice && !set_nice(m_nice)) skipped |= NICE;
+            return skipped;
+        }
+
+        /**
+         * @return CPUs workers may run on, empty means any.
+         */
+        std::vector<int> cpus() const {
+            if (m_node < 0) return m_cpus;
+            auto node = node_cpus(m_node);
+            if (node.empty()) return m_cpus;
+            if (m_cpus.empty()) return node;
+            std::vector<int> both;
+            for (auto cpu : m_cpus) {
+                if (std::find(node.begin(), node.end(), cpu) != node.end()) both.push_back(cpu);
+            }
+            return both.empty() ? m_cpus : both;
+        }
+
+        /**
+         * @param node NUMA node index
+         * @return CPUs of node, empty if unknown.
+         */
+        static std::vector<int> node_cpus(int node) {
+            std::vector<int> cpus;
+#if OHM_PLATFORM_OS_LINUX
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!std::getline(file, list)) return cpus;
+            // format like "0-7,16-23"
+            std::istringstream ranges(list);
+            std::string range;
+            while (std::getline(ranges, range, ',')) {
+                if (range.empty()) continue;
+                auto dash = range.find('-');
+                auto first = std::atoi(range.substr(0, dash).c_str());
+                auto last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+                for (auto cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+            }
+#else
+            (void) node;
+#endif
+            return cpus;
+        }
+
+    private:
+        std::vector<int> m_cpus;
+        int m_node = -1;
+        bool m_spread = false;
+        int m_fifo = 0;
+        int m_nice = 0;
+        bool m_has_nice = false;
+
+        static bool set_affinity(const std::vector<int> &cpus) {
+#if OHM_PLATFORM_OS_LINUX
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (auto cpu : cpus) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+            }
+            return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif OHM_PLATFORM_OS_WINDOWS
+            DWORD_PTR mask = 0;
+            for (auto cpu : cpus) {
+                if (cpu >= 0 && cpu < int(sizeof(DWORD_PTR) * 8)) mask |= DWORD_PTR(1) << cpu;
+            }
+            return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+            (void) cpus;
+            return false;
+#endif
+        }
+
+        static bool prefer_node(int node) {
+#if OHM_PLATFORM_OS_LINUX && defined(SYS_set_mempolicy)
+            static const int mpol_preferred = 1;    // MPOL_PREFERRED of numaif.h
+            if (node >= int(sizeof(unsigned long) * 8)) return false;
+            unsigned long mask = 1UL << node;
+            return syscall(SYS_set_mempolicy, mpol_preferred, &mask, sizeof(mask) * 8) == 0;
+#else
+            (void) node;
+            return false;
+#endif
+        }
+
+        static bool set_fifo(int priority) {
+#if OHM_PLATFORM_OS_WINDOWS
+            (void) priority;
+            return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+            sched_param param;
+            param.sched_priority = priority;
+            return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+        }
+
+        static bool set_nice(int nice) {
+#if OHM_PLATFORM_OS_LINUX
+            // on Linux, nice value is per thread
+            auto tid = id_t(syscall(SYS_gettid));
+            return setpriority(PRIO_PROCESS, tid, nice) == 0;
+#elif OHM_PLATFORM_OS_WINDOWS
+            int priority = nice < -10 ? THREAD_PRIORITY_HIGHEST
+                         : nice < 0 ? THREAD_PRIORITY_ABOVE_NORMAL
+                         : nice == 0 ? THREAD_PRIORITY_NORMAL
+                         : nice < 10 ? THREAD_PRIORITY_BELOW_NORMAL
+                         : THREAD_PRIORITY_LOWEST;
+            return SetThreadPriority(GetCurrentThread(), priority) != 0;
+#else
+            (void) nice;
+            return false;
+#endif
+        }
+    };
+}
+
+#endif //OMEGA_THREAD_PLACEMENT_H
@@ -8,10 +8,90 @@
 #include <atomic>
 #include <deque>
 #include <memory>
+#include <mutex>
 
 #include "../time.h"
+#include "sharded_counter.h"
+#include "coarse_clock.h"
 
 namespace ohm {
+    /**
+     * Differences of two counters over the latest fixed span of time, counters are sampled by reports.
+     * The span does not change with how often or by whom reported,
+     *   counts at start of span are interpolated between the samples around it.
+     * Not thread safe, reports sampling it should be serialized.
+     */
+    class CountWindow {
+    public:
+        using self = CountWindow;
+
+        struct Difference {
+            double seconds;     ///< span of difference, shorter than window only near beginning
+            double first;       ///< difference of first counter
+            double second;      ///< difference of second counter
+        };
+
+        /**
+         * @param span counters are compared with themselves `span` before, at least 1 millisecond
+         */
+        explicit CountWindow(time::ms span)
+                : m_span(span < time::ms(1) ? time::ms(1) : span) {
+            m_samples.push_back({steady_now(), 0, 0});
+        }
+
+        /**
+         * Sample counters, time of samples should not go back.
+         * @return differences from start of window to this sample
+         */
+        Difference sample(steady_point now_time, int64_t first, int64_t second) {
+            // merge samples closer than 1/64 of span, so frequent reports do not grow samples
+            auto size = m_samples.size();
+            if (size > 1 && now_time - m_samples[size - 2].time < m_span / 64) {
+                m_samples.back() = {now_time, first, second};
+            } else {
+                m_samples.push_back({now_time, first, second});
+            }
+            // keep one sample at or before start of span
+            auto start = now_time - m_span;
+            while (m_samples.size() > 1 && m_samples[1].time <= start) m_samples.pop_front();
+
+            auto &front = m_samples.front();
+            Difference result = {};
+            if (front.time >= start) {
+                result.seconds = Seconds(now_time - front.time);
+                result.first = double(first - front.first);
+                result.second = double(second - front.second);
+                return result;
+            }
+            auto &next = m_samples[1];
+            auto ratio = Seconds(start - front.time) / Seconds(next.time - front.time);
+            result.seconds = Seconds(m_span);
+            result.first = double(first - front.first) - ratio * double(next.first - front.first);
+            result.second = double(second - front.second) - ratio * double(next.second - front.second);
+            return result;
+        }
+
+    private:
+        struct Sample {
+            steady_point time;
+            int64_t first;
+            int64_t second;
+        };
+
+        steady_point::duration m_span;
+        std::deque<Sample> m_samples;
+
+        template<typename Rep, typename Period>
+        static double Seconds(std::chrono::duration<Rep, Period> duration) {
+            return std::chrono::duration<double>(duration).count();
+        }
+    };
+
+    /**
+     * Count values in and out of queue, and rates of them.
+     * Counting is lock-free on sharded counters, rates are of the latest `window` time, sampled by reports.
+     * Time of last value is stamped on shards by `CoarseClock`, each shard stores at most once each millisecond.
+     */
     class InOutCounter {
     public:
         using self = InOutCounter;
@@ -20,83 +100,105 @@ namespace ohm {
             int64_t count;
             struct {
                 float dps;
-                time::ms waited_time;
+                time::ms waited_time;   ///< time since last value, in about 1 millisecond precision
+                int64_t total;          ///< values since beginning
             } in, out;
         };
 
-        explicit InOutCounter(size_t windows_size = 60)
-                : m_beginning(now()), m_window_size(windows_size < 2 ? 2 : windows_size), m_count(0) {}
+        /**
+         * @param window rates are averaged over the latest `window` time, however often reported
+         */
+        explicit InOutCounter(time::ms window = time::sec(2))
+                : m_window(window) {
+            for (auto &stamp : m_in_stamps) stamp.time.store(0, std::memory_order_relaxed);
+            for (auto &stamp : m_out_stamps) stamp.time.store(0, std::memory_order_relaxed);
+        }
 
         InOutCounter(const InOutCounter &) = delete;
 
         InOutCounter &operator=(const InOutCounter &) = delete;
 
         void in() {
-            ++m_count;
-            tick(m_in, now());
+            m_in.add(1);
+            stamp(m_in_stamps);
         }
 
         void out() {
-            --m_count;
-            tick(m_out, now());
+            m_out.add(1);
+            stamp(m_out_stamps);
+        }
+
+        void in(int64_t n) {
+            m_in.add(n);
+            stamp(m_in_stamps);
+        }
+
+        void out(int64_t n) {
+            m_out.add(n);
+            stamp(m_out_stamps);
         }
 
         Report report() {
-            auto now_time_point = time::count<time::ms>(now() - m_beginning);
+            std::unique_lock<std::mutex> _lock(m_report_mutex);
+            auto now_time = steady_now();
+            // load out first, so count is not negative by values coming between
+            auto out = m_out.load();
+            auto in = m_in.load();
 
-            int64_t count = m_count;
-            int64_t in_each_spent_time = m_in.each_spent_time;
-            int64_t in_last_time_point = m_in.last_time_point;
-            int64_t out_each_spent_time = m_out.each_spent_time;
-            int64_t out_last_time_point = m_out.last_time_point;
+            auto window = m_window.sample(now_time, in, out);
 
             Report result = {};
-            result.count = count;
-            result.in.dps = in_each_spent_time == 0
-                    ? 0
-                    : float(1000) / in_each_spent_time;
-            result.out.dps = out_each_spent_time == 0
-                    ? 0
-                    : float(1000) / out_each_spent_time;
-            result.in.waited_time = in_last_time_point == 0
-                    ? time::ms(0)
-                    : time::ms(now_time_point - in_last_time_point);
-            result.out.waited_time = in_last_time_point == 0
-                    ? time::ms(0)
-                    : time::ms(now_time_point - out_last_time_point);
+            result.count = in > out ? in - out : 0;
+            result.in.total = in;
+            result.out.total = out;
+            result.in.dps = window.seconds <= 0 ? 0 : float(window.first / window.seconds);
+            result.out.dps = window.seconds <= 0 ? 0 : float(window.second / window.seconds);
+            result.in.waited_time = waited(m_in_stamps, now_time);
+            result.out.waited_time = waited(m_out_stamps, now_time);
 
             return result;
         }
 
     private:
-        time_point m_beginning;
-        size_t m_window_size;
+        static const size_t Shards = 16;
 
-        std::atomic<int64_t> m_count;
+        // padded like `ShardedCounter`, each thread stamps its own cache line
+        struct Stamp {
+            std::atomic<int64_t> time;      ///< coarse time of last value, 0 if no value
+            char padding[64 - sizeof(std::atomic<int64_t>)];
+        };
 
-        struct Pot {
-            std::deque<time_point> every_time_point;
-            std::atomic<int64_t> last_time_point;
-            std::atomic<int64_t> each_spent_time;
+        ShardedCounter m_in;
+        ShardedCounter m_out;
 
-            Pot()
-                    : last_time_point(0), each_spent_time(0) {}
-        } m_in, m_out;
+        CoarseClock m_clock;
+        Stamp m_in_stamps[Shards];
+        Stamp m_out_stamps[Shards];
 
-    private:
-        void tick(Pot &pot, time_point now_time) {
-            pot.last_time_point = time::count<time::ms>(now_time - m_beginning);
-            pot.every_time_point.push_back(now_time);
-            if (pot.every_time_point.size() < 2) {
-                return;
-            }
-            pot.each_spent_time =
-                    time::count<time::ms>(now_time - pot.every_time_point.front())
-                    / pot.every_time_point.size();
-            while (pot.every_time_point.size() > m_window_size
-                   && now_time - pot.every_time_point.front() > time::sec(1)) {
-                pot.every_time_point.pop_front();
+        std::mutex m_report_mutex;      ///< only taken by reports
+        CountWindow m_window;           ///< counts in and out over the latest window
+
+        /**
+         * Stamp coarse time on shard of calling thread, only stored if the clock ticked since last stamp.
+         */
+        void stamp(Stamp (&stamps)[Shards]) {
+            auto now_time = m_clock.now().time_since_epoch().count();
+            auto &stamp = stamps[ShardedCounter::Shard() % Shards].time;
+            if (stamp.load(std::memory_order_relaxed) < now_time) stamp.store(now_time, std::memory_order_relaxed);
+        }
+
+        /**
+         * @return time since the latest stamp of all shards, 0 if no value
+         */
+        static time::ms waited(const Stamp (&stamps)[Shards], steady_point now_time) {
+            int64_t last = 0;
+            for (auto &stamp : stamps) {
+                auto stamped = stamp.time.load(std::memory_order_relaxed);
+                if (stamped > last) last = stamped;
             }
+            if (last == 0) return time::ms(0);
+            auto waited = now_time - steady_point(steady_point::duration(last));
+            return waited.count() <= 0 ? time::ms(0) : std::chrono::duration_cast<time::ms>(waited);
         }
     };
 
@@ -122,6 +224,20 @@ namespace ohm {
             };
         }
 
+        std::function<void(int64_t)> input_counter() {
+            auto counter = m_counter;
+            return [counter](int64_t n) {
+                counter->in(n);
+            };
+        }
+
+        std::function<void(int64_t)> output_counter() {
+            auto counter = m_counter;
+            return [counter](int64_t n) {
+                counter->out(n);
+            };
+        }
+
         Report report() {
             return m_counter->report();
         }
@@ -0,0 +1,248 @@
+//
+// Created by kier on 2020/12/2.
+//
+
+#ifndef OMEGA_RING_BUFFER_H
+#define OMEGA_RING_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace ohm {
+    /**
+     * Round capacity up to power of 2, at least 2.
+     * @param capacity wanted capacity
+     * @return ring capacity
+     */
+    inline size_t ring_capacity(size_t capacity) {
+        size_t ring = 2;
+        while (ring < capacity) ring <<= 1;
+        return ring;
+    }
+
+    /**
+     * Bounded lock-free multi-producer multi-consumer ring buffer.
+     * Each cell has its own sequence number, so producers and consumers only contend on one CAS each.
+     * @tparam T value type, only need move constructible.
+     */
+    template<typename T>
+    class MPMCRingBuffer {
+    public:
+        using self = MPMCRingBuffer;
+
+        /**
+         * @param capacity ring capacity, will round up to power of 2.
+         */
+        explicit MPMCRingBuffer(size_t capacity)
+                : m_mask(ring_capacity(capacity) - 1)
+                , m_cells(new Cell[m_mask + 1])
+                , m_enqueue(0), m_dequeue(0) {
+            for (size_t i = 0; i <= m_mask; ++i) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~MPMCRingBuffer() {
+            while (try_pop_with([](T &&) {}));
+        }
+
+        MPMCRingBuffer(const MPMCRingBuffer &) = delete;
+
+        MPMCRingBuffer &operator=(const MPMCRingBuffer &) = delete;
+
+        /**
+         * Try push value, `value` only be moved if push succeed.
+         * @param value pushing value
+         * @return false if ring is full
+         */
+        bool try_push(T &value) {
+            Cell *cell;
+            auto pos = m_enqueue.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &m_cells[pos & m_mask];
+                auto seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = intptr_t(seq) - intptr_t(pos);
+                if (diff == 0) {
+                    if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = m_enqueue.load(std::memory_order_relaxed);
+                }
+            }
+            new(&cell->storage) T(std::move(value));
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool try_push(T &&value) {
+            return try_push(value);
+        }
+
+        /**
+         * Try pop value, and give it to `receiver(T &&)`.
+         * @param receiver called with popped value, should only move the value away.
+         * @return false if ring is empty
+         */
+        template<typename FUNC>
+        bool try_pop_with(FUNC receiver) {
+            Cell *cell;
+            auto pos = m_dequeue.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &m_cells[pos & m_mask];
+                auto seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = intptr_t(seq) - intptr_t(pos + 1);
+                if (diff == 0) {
+                    if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = m_dequeue.load(std::memory_order_relaxed);
+                }
+            }
+            auto &value = *reinterpret_cast<T *>(&cell->storage);
+            receiver(std::move(value));
+            value.~T();
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool try_pop(T &value) {
+            return try_pop_with([&](T &&popped) { value = std::move(popped); });
+        }
+
+        /**
+         * @return approximate number of values in ring
+         */
+        size_t size() const {
+            auto dequeue = m_dequeue.load(std::memory_order_acquire);
+            auto enqueue = m_enqueue.load(std::memory_order_acquire);
+            return enqueue > dequeue ? enqueue - dequeue : 0;
+        }
+
+        bool empty() const { return size() == 0; }
+
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        };
+
+        size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+
+        char m_pad0[64];
+        std::atomic<size_t> m_enqueue;
+        char m_pad1[64];
+        std::atomic<size_t> m_dequeue;
+        char m_pad2[64];
+    };
+
+    /**
+     * Bounded lock-free ring buffer for exactly one producer thread and one consumer thread.
+     * @tparam T value type, only need move constructible.
+     */
+    template<typename T>
+    class SPSCRingBuffer {
+    public:
+        using self = SPSCRingBuffer;
+
+        /**
+         * @param capacity ring capacity, will round up to power of 2.
+         */
+        explicit SPSCRingBuffer(size_t capacity)
+                : m_mask(ring_capacity(capacity) - 1)
+                , m_cells(new Storage[m_mask + 1])
+                , m_tail(0), m_head_cache(0)
+                , m_head(0), m_tail_cache(0) {
+        }
+
+        ~SPSCRingBuffer() {
+            while (try_pop_with([](T &&) {}));
+        }
+
+        SPSCRingBuffer(const SPSCRingBuffer &) = delete;
+
+        SPSCRingBuffer &operator=(const SPSCRingBuffer &) = delete;
+
+        /**
+         * Try push value, `value` only be moved if push succeed.
+         * @param value pushing value
+         * @return false if ring is full
+         * @note only called by producer thread
+         */
+        bool try_push(T &value) {
+            auto tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head_cache > m_mask) {
+                m_head_cache = m_head.load(std::memory_order_acquire);
+                if (tail - m_head_cache > m_mask) return false;
+            }
+            new(&m_cells[tail & m_mask]) T(std::move(value));
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool try_push(T &&value) {
+            return try_push(value);
+        }
+
+        /**
+         * Try pop value, and give it to `receiver(T &&)`.
+         * @param receiver called with popped value, should only move the value away.
+         * @return false if ring is empty
+         * @note only called by consumer thread
+         */
+        template<typename FUNC>
+        bool try_pop_with(FUNC receiver) {
+            auto head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail_cache) {
+                m_tail_cache = m_tail.load(std::memory_order_acquire);
+                if (head == m_tail_cache) return false;
+            }
+            auto &value = *reinterpret_cast<T *>(&m_cells[head & m_mask]);
+            receiver(std::move(value));
+            value.~T();
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool try_pop(T &value) {
+            return try_pop_with([&](T &&popped) { value = std::move(popped); });
+        }
+
+        /**
+         * @return approximate number of values in ring
+         */
+        size_t size() const {
+            auto head = m_head.load(std::memory_order_acquire);
+            auto tail = m_tail.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+        bool empty() const { return size() == 0; }
+
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+        size_t m_mask;
+        std::unique_ptr<Storage[]> m_cells;
+
+        char m_pad0[64];
+        std::atomic<size_t> m_tail;     ///< written by producer
+        size_t m_head_cache;            ///< producer's view of head
+        char m_pad1[64];
+        std::atomic<size_t> m_head;     ///< written by consumer
+        size_t m_tail_cache;            ///< consumer's view of tail
+        char m_pad2[64];
+    };
+}
+
+#endif //OMEGA_RING_BUFFER_H
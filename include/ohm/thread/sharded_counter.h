@@ -0,0 +1,71 @@
+//
+// Created by kier on 2020/12/18.
+//
+
+#ifndef OMEGA_SHARDED_COUNTER_H
+#define OMEGA_SHARDED_COUNTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace ohm {
+    /**
+     * Counter added by many threads, each thread adds to its own shard on its own cache line.
+     * Adding is one relaxed atomic add without contention, reading sums all shards.
+     */
+    class ShardedCounter {
+    public:
+        using self = ShardedCounter;
+
+        ShardedCounter() {
+            for (auto &shard : m_shards) shard.value.store(0, std::memory_order_relaxed);
+        }
+
+        ShardedCounter(const ShardedCounter &) = delete;
+
+        ShardedCounter &operator=(const ShardedCounter &) = delete;
+
+        void add(int64_t n) {
+            m_shards[Shard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        /**
+         * @return sum of all shards, adds running concurrently may be not counted.
+         */
+        int64_t load() const {
+            int64_t sum = 0;
+            for (auto &shard : m_shards) sum += shard.value.load(std::memory_order_relaxed);
+            return sum;
+        }
+
+        /**
+         * Set all shards to 0, adds running concurrently may be kept.
+         */
+        void reset() {
+            for (auto &shard : m_shards) shard.value.store(0, std::memory_order_relaxed);
+        }
+
+        /**
+         * @return shard index of calling thread, threads take shards in turn.
+         */
+        static size_t Shard() {
+            static std::atomic<size_t> next(0);
+            static thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % Size;
+            return index;
+        }
+
+    private:
+        static const size_t Size = 16;
+
+        // padded instead of aligned, `new` of over-aligned type is not supported before C++17
+        struct Cell {
+            std::atomic<int64_t> value;
+            char padding[64 - sizeof(std::atomic<int64_t>)];
+        };
+
+        Cell m_shards[Size];
+    };
+}
+
+#endif //OMEGA_SHARDED_COUNTER_H
@@ -2,6 +2,7 @@
 #define OMEGA_THREAD_SHOTGUN_H
 
 #include "cartridge.h"
+#include "placement.h"
 #include "../need.h"
 
 #include <vector>
@@ -29,6 +30,23 @@ namespace ohm {
             _dispose.release();
         }
 
+        /**
+         * @brief Shotgun
+         * @param clip_size The cartridge number in clip. Number of threads
+         * @param placement applied in each thread, the thread index is cartridge index
+         */
+        Shotgun(size_t clip_size, const ThreadPlacement &placement)
+                : m_clip(clip_size, nullptr) {
+            need _dispose(&self::dispose, this);
+            for (int i = 0; i < static_cast<int>(clip_size); ++i) {
+                m_clip[i] = placement.empty()
+                            ? new Cartridge()
+                            : new Cartridge([placement, i]() { placement.apply(size_t(i)); });
+                m_chest.push_back(i);   // push all cartridge into chest
+            }
+            _dispose.release();
+        }
+
         ~Shotgun() {
             this->dispose();
         }
@@ -0,0 +1,78 @@
+//
+// Created by kier on 2020/12/14.
+//
+
+#ifndef OMEGA_SPIN_WAIT_H
+#define OMEGA_SPIN_WAIT_H
+
+#include "../platform.h"
+
+#include <thread>
+#include <atomic>
+#include <cstddef>
+
+#if defined(OHM_PLATFORM_IS_X86) && OHM_PLATFORM_CC_MSVC
+#include <intrin.h>
+#endif
+
+namespace ohm {
+    /**
+     * Tell CPU this thread is spinning, save power and give way to the other hyper-thread.
+     */
+    inline void cpu_relax() {
+#if defined(OHM_PLATFORM_IS_X86) && OHM_PLATFORM_CC_MSVC
+        _mm_pause();
+#elif defined(OHM_PLATFORM_IS_X86) && OHM_PLATFORM_CC_GCC
+        __builtin_ia32_pause();
+#elif (defined(__aarch64__) || defined(__arm__)) && OHM_PLATFORM_CC_GCC
+        __asm__ __volatile__("yield");
+#else
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+    /**
+     * Count steps of busy waiting: spin `spins` times, then yield `yields` times.
+     * Usage:
+     * ```
+     * SpinWait spin(1024, 64);
+     * while (!ready()) {
+     *     if (!spin.once()) { park(); break; }
+     * }
+     * ```
+     */
+    class SpinWait {
+    public:
+        using self = SpinWait;
+
+        SpinWait(size_t spins, size_t yields)
+                : m_spins(spins), m_yields(yields), m_count(0) {}
+
+        /**
+         * Do one step of waiting.
+         * @return false if all steps done, caller should park.
+         */
+        bool once() {
+            if (m_count < m_spins) {
+                cpu_relax();
+            } else if (m_count < m_spins + m_yields) {
+                std::this_thread::yield();
+            } else {
+                return false;
+            }
+            ++m_count;
+            return true;
+        }
+
+        void reset() {
+            m_count = 0;
+        }
+
+    private:
+        size_t m_spins;
+        size_t m_yields;
+        size_t m_count;
+    };
+}
+
+#endif //OMEGA_SPIN_WAIT_H
@@ -0,0 +1,222 @@
+//
+// Created by kier on 2020/12/8.
+//
+
+#ifndef OMEGA_WORK_STEALING_H
+#define OMEGA_WORK_STEALING_H
+
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <memory>
+
+#include "placement.h"
+
+namespace ohm {
+    /**
+     * Thread pool with one task deque for each thread.
+     * Task posted from pool thread goes to its own deque, others go to the shared injection queue.
+     * Idle thread steals from other threads before sleeping.
+     */
+    class WorkStealingPool {
+    public:
+        using self = WorkStealingPool;
+        using Task = std::function<void()>;
+
+        /**
+         * @param size number of threads, 0 means number of hardware threads.
+         */
+        explicit WorkStealingPool(size_t size = 0)
+                : self(size, ThreadPlacement()) {}
+
+        /**
+         * @param size number of threads, 0 means number of hardware threads.
+         * @param placement applied in each thread, the thread index is worker index
+         */
+        WorkStealingPool(size_t size, ThreadPlacement placement)
+                : m_running(true), m_pending(0), m_sleepers(0), m_placement(std::move(placement)) {
+            if (size == 0) size = std::thread::hardware_concurrency();
+            if (size == 0) size = 1;
+            for (size_t i = 0; i < size; ++i) {
+                m_workers.emplace_back(new Worker);
+            }
+            for (size_t i = 0; i < size; ++i) {
+                m_workers[i]->thread = std::thread(&self::operating, this, i);
+            }
+        }
+
+        ~WorkStealingPool() {
+            m_running = false;
+            {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                m_cond.notify_all();
+            }
+            for (auto &worker : m_workers) {
+                if (worker->thread.joinable()) worker->thread.join();
+            }
+        }
+
+        WorkStealingPool(const WorkStealingPool &) = delete;
+
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+        /**
+         * Post task to pool.
+         * @param task task to run
+         */
+        void post(Task task) {
+            auto &local = Local();
+            if (local.pool == this) {
+                auto &worker = *m_workers[local.index];
+                std::unique_lock<std::mutex> _lock(worker.mutex);
+                worker.tasks.push_back(std::move(task));
+            } else {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                m_inject.push_back(std::move(task));
+            }
+            ++m_pending;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_sleepers.load() > 0) {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                m_cond.notify_one();
+            }
+        }
+
+        /**
+         * Run one pending task in calling thread, only work on thread of this pool.
+         * Call it instead of blocking, so waiting task would not starve the tasks it waits for.
+         * @return false if no task run
+         */
+        bool help() {
+            auto &local = Local();
+            if (local.pool != this || local.depth >= 8) return false;
+            Task task;
+            if (!take(local.index, task)) return false;
+            ++local.depth;
+            task();
+            --local.depth;
+            return true;
+        }
+
+        /**
+         * @return number of threads
+         */
+        size_t size() const {
+            return m_workers.size();
+        }
+
+        /**
+         * @return number of tasks waiting to run
+         */
+        size_t pending() const {
+            return m_pending.load();
+        }
+
+        /**
+         * @return the pool running current thread, nullptr if current thread not in any pool
+         */
+        static WorkStealingPool *current() {
+            return Local().pool;
+        }
+
+        /**
+         * @return number of tasks run by `help` in current thread and not finished yet.
+         * Task running nested should not wait for tasks below it in the same thread.
+         */
+        static int depth() {
+            return Local().depth;
+        }
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            std::thread thread;
+        };
+
+        struct Context {
+            WorkStealingPool *pool = nullptr;
+            size_t index = 0;
+            int depth = 0;
+        };
+
+        static Context &Local() {
+            static thread_local Context context;
+            return context;
+        }
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::deque<Task> m_inject;          ///< tasks posted from outside of pool
+
+        std::atomic<bool> m_running;
+        std::atomic<size_t> m_pending;      ///< number of tasks in all deques
+        std::atomic<int> m_sleepers;
+        ThreadPlacement m_placement;        ///< applied in each worker thread
+
+        bool take(size_t index, Task &task) {
+            if (m_pending.load() == 0) return false;
+            {
+                // newest task of own deque, it is still hot in cache
+                auto &worker = *m_workers[index];
+                std::unique_lock<std::mutex> _lock(worker.mutex);
+                if (!worker.tasks.empty()) {
+                    task = std::move(worker.tasks.back());
+                    worker.tasks.pop_back();
+                    --m_pending;
+                    return true;
+                }
+            }
+            {
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                if (!m_inject.empty()) {
+                    task = std::move(m_inject.front());
+                    m_inject.pop_front();
+                    --m_pending;
+                    return true;
+                }
+            }
+            // steal oldest task of others
+            auto size = m_workers.size();
+            for (size_t i = 1; i < size; ++i) {
+                auto &victim = *m_workers[(index + i) % size];
+                std::unique_lock<std::mutex> _lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    --m_pending;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void operating(size_t index) {
+            if (!m_placement.empty()) m_placement.apply(index);
+            auto &local = Local();
+            local.pool = this;
+            local.index = index;
+            Task task;
+            while (m_running) {
+                if (take(index, task)) {
+                    task();
+                    task = nullptr;
+                    continue;
+                }
+                std::unique_lock<std::mutex> _lock(m_mutex);
+                ++m_sleepers;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (m_running && m_pending.load() == 0) m_cond.wait(_lock);
+                --m_sleepers;
+            }
+        }
+    };
+}
+
+#endif //OMEGA_WORK_STEALING_H
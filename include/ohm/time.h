@@ -7,6 +7,7 @@
 
 #include "platform.h"
 #include "print.h"
+#include "clock.h"
 
 #include <string>
 #include <chrono>
@@ -40,6 +41,13 @@ namespace ohm {
 
     inline time_point now() { return std::chrono::system_clock::now(); }
 
+    /**
+     * Time point to measure durations, not changed by adjusting wall time, see `MonotonicClock`.
+     */
+    using steady_point = MonotonicClock::time_point;
+
+    inline steady_point steady_now() { return MonotonicClock::now(); }
+
     template<>
     struct printable<time_point> {
         using type = time_point;
@@ -25,21 +25,21 @@ namespace ohm {
 
         IfTimeSummary &operator=(const IfTimeSummary &) = delete;
 
-        using Duration = decltype(ohm::now() - ohm::now());
+        using Duration = decltype(ohm::steady_now() - ohm::steady_now());
 
         explicit IfTimeSummary(const std::string &module)
                 : m_module(module) {
-            auto now = ohm::now();
+            auto now = ohm::steady_now();
             m_start = now;
             m_last = now;
         }
 
         void nap() {
-            m_last = ohm::now();
+            m_last = ohm::steady_now();
         }
 
         void done(const std::string &tag) {
-            auto now = ohm::now();
+            auto now = ohm::steady_now();
             auto spent = now - m_last;
             m_last = now;
             m_summary.emplace_back(std::make_pair(tag, spent));
@@ -62,8 +62,8 @@ namespace ohm {
     private:
         std::string m_module;
         std::vector<std::pair<std::string, Duration>> m_summary;
-        ohm::time_point m_start;
-        ohm::time_point m_last;
+        ohm::steady_point m_start;
+        ohm::steady_point m_last;
     };
 
     template<>
@@ -0,0 +1,44 @@
+//
+// Created by kier on 2020/12/11.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/pipe/pipe_autoscaler.h"
+#include "ohm/print.h"
+
+int main() {
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 1500) throw ohm::PipeBreak();
+        // input is faster at first, then slower
+        std::this_thread::sleep_for(std::chrono::microseconds(next < 1000 ? 500 : 5000));
+        return next++;
+    });
+
+    std::atomic<int> count(0);
+
+    // start with 1 thread, autoscaler finds how many needed.
+    input.limit(32).profile("detect")
+            .map(1, [](int x) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(4));
+                return x;
+            })
+            .seal([&](int) { ++count; });
+
+    ohm::PipeAutoscaler autoscaler(input.profiler(), ohm::time::ms(200));
+    autoscaler.stage("detect", 1, 16).verbose(true);
+    autoscaler.start();
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+    autoscaler.stop();
+
+    auto report = input.report();
+    ohm::println("count: ", count.load(), ", threads at last: ", report.report["detect"].threads);
+    for (auto &event : report.events) {
+        ohm::println(event);
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+//
+// Created by kier on 2020/12/21.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+/**
+ * Run 3 replicas, replica 2 is 4 times faster than replica 0, replica 1 is twice.
+ */
+void run(const std::string &name, const ohm::PipeBalancing &balancing) {
+    static const int REPLICAS = 3;
+    static const int COST[REPLICAS] = {400, 200, 100};  // microseconds each value
+
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 2000) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::vector<std::atomic<int>> counts(REPLICAS);
+    for (auto &count : counts) count = 0;
+
+    auto replicas = input.limit(16).dispatch(REPLICAS, balancing);
+    // each replica queue is short, so slow replica slows down dispatching less
+    replicas.limit(8);
+    for (int i = 0; i < REPLICAS; ++i) {
+        replicas[i].seal(1, [&counts, i](int) {
+            std::this_thread::sleep_for(ohm::time::us(COST[i]));
+            ++counts[i];
+        });
+    }
+
+    auto start = ohm::steady_now();
+    input.loop();
+    input.close();
+    input.completion().wait();
+    auto spent = ohm::steady_now() - start;
+
+    ohm::println(name, ": ", spent, ", values of replicas: ",
+                 counts[0].load(), ", ", counts[1].load(), ", ", counts[2].load());
+}
+
+int main() {
+    run("round robin ", ohm::PipeBalancing::RoundRobin());
+    run("weighted    ", ohm::PipeBalancing::Weighted({1, 2, 4}));
+    run("least queued", ohm::PipeBalancing::LeastQueued());
+    run("two choices ", ohm::PipeBalancing::TwoChoices());
+    run("least queued, weighted", ohm::PipeBalancing::LeastQueued({1, 2, 4}));
+    return 0;
+}
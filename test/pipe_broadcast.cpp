@@ -0,0 +1,53 @@
+//
+// Created by kier on 2020/12/12.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+struct Frame {
+    int id;
+    std::vector<uint8_t> pixels;
+
+    explicit Frame(int id) : id(id), pixels(1920 * 1080 * 3) {}
+
+    Frame(Frame &&) = default;
+
+    Frame(const Frame &) = delete;
+
+    Frame &operator=(const Frame &) = delete;
+};
+
+int main() {
+    int next = 0;
+    ohm::Tap<Frame> input([&]() -> Frame {
+        if (next >= 100) throw ohm::PipeBreak();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return Frame(next++);
+    });
+
+    std::atomic<int> detected(0), recorded(0), shown(0);
+
+    // each branch gets the same frame object, no copy.
+    auto branches = input.limit(4).broadcast(1, 3);
+    branches[0].limit(4).seal(2, [&](std::shared_ptr<const Frame> frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        ++detected;
+    });
+    branches[1].limit(16).seal(1, [&](std::shared_ptr<const Frame> frame) {
+        ++recorded;
+    });
+    // slow UI drops old frames, never slows down detector and recorder.
+    branches[2].limit(1).keep_new().seal(1, [&](std::shared_ptr<const Frame> frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ++shown;
+    });
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+
+    ohm::println("detected: ", detected.load(), ", recorded: ", recorded.load(), ", shown: ", shown.load());
+
+    return 0;
+}
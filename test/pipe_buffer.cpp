@@ -0,0 +1,58 @@
+//
+// Created by kier on 2020/12/18.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+#include <cstring>
+
+struct Frame {
+    int stream;
+    int index;
+    ohm::PipeBuffer pixels;
+};
+
+int main() {
+    static const int STREAMS = 4;
+    static const int FRAMES = 200;
+    static const size_t FRAME_SIZE = 1920 * 1080 * 3;
+
+    // decoded frames reuse memory of frames already shown
+    ohm::PipeBufferPool pool;
+
+    std::vector<int> next(STREAMS, 0);
+    ohm::Tap<Frame> decoder(STREAMS, [&](int stream) -> Frame {
+        auto index = next[stream]++;
+        if (index >= FRAMES) throw ohm::PipeBreak();
+        Frame frame{stream, index, pool.acquire(FRAME_SIZE)};
+        std::memset(frame.pixels.data(), index & 0xff, frame.pixels.size());
+        return frame;
+    });
+
+    std::atomic<int> shown(0);
+    decoder.pool(pool).profile("decode")
+            .bytes([](const Frame &frame) { return int64_t(frame.pixels.size()); }, 64 << 20)
+            .map(2, [](Frame frame) {
+                // shallow copies share pixels, last one returns them to pool
+                auto preview = frame.pixels;
+                preview.data()[0] = 0;
+                return frame;
+            }).profile("show")
+            .seal(1, [&](Frame) { ++shown; });
+
+    decoder.loop();
+    decoder.close();
+    decoder.completion().wait();
+
+    auto stats = pool.stats();
+    ohm::println("shown: ", shown.load(), " frames");
+    ohm::println("pool hits: ", stats.hits, ", misses: ", stats.misses,
+                 ", cached: ", stats.cached >> 20, "MB, on huge pages: ", stats.huge);
+
+    auto report = decoder.report();
+    ohm::println("decode line, pool_hits: ", report.report["decode"].metrics["pool_hits"],
+                 ", pool_used: ", report.report["decode"].metrics["pool_used"] >> 20, "MB");
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+//
+// Created by kier on 2020/12/17.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+struct Image {
+    int id;
+    std::vector<uint8_t> pixels;
+};
+
+int64_t image_bytes(const Image &image) {
+    return int64_t(image.pixels.size());
+}
+
+int main() {
+    static const int64_t MB = 1024 * 1024;
+
+    // every 10th frame is 4K frame, others are thumbnails
+    int next = 0;
+    ohm::Tap<Image> camera([&]() -> Image {
+        if (next >= 200) throw ohm::PipeBreak();
+        auto id = next++;
+        return {id, std::vector<uint8_t>(id % 10 == 0 ? 3840 * 2160 * 3 : 320 * 180 * 3)};
+    });
+
+    std::atomic<int64_t> peak(0);
+    std::atomic<int> shown(0);
+    auto budget = [&]() {
+        auto used = camera.profiler()->budget()->used();
+        if (used > peak) peak = used;
+    };
+
+    // all pipes together keep at most 64MB of images, decode pipe at most 32MB
+    camera.budget(64 * MB).bytes(image_bytes, 32 * MB).profile("decode")
+            .map(1, [&](Image image) {
+                budget();
+                std::this_thread::sleep_for(std::chrono::milliseconds(3));
+                return image;
+            })
+            .bytes(image_bytes).keep_new().profile("detect")
+            .map(1, [&](Image image) {
+                budget();
+                std::this_thread::sleep_for(std::chrono::milliseconds(image.id % 10 == 0 ? 20 : 2));
+                return image;
+            })
+            .profile("show")
+            .seal(1, [&](Image) { ++shown; });
+
+    std::thread monitor([&]() {
+        auto done = camera.completion();
+        while (done.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+            auto report = camera.report();
+            ohm::println("bytes in decode: ", report.report["decode"].metrics["bytes"] / MB, "MB, detect: ",
+                         report.report["detect"].metrics["bytes"] / MB, "MB");
+        }
+    });
+
+    camera.loop();
+    camera.close();
+    camera.completion().wait();
+    monitor.join();
+
+    ohm::println("shown: ", shown.load(), ", peak bytes of pipeline: ", peak.load() / MB, "MB");
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+//
+// Created by kier on 2020/12/10.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+/**
+ * Run one job, return after all data sealed.
+ */
+void job(int id, std::shared_ptr<ohm::WorkStealingPool> pool) {
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 1000) throw ohm::PipeBreak();
+        return next++;
+    });
+    if (pool) input.executor(pool);
+
+    std::atomic<int> even(0), odd(0), large(0);
+
+    auto cases = input.limit(16)
+            .map(2, [](int x) { return x * 3; })
+            .parallel(1, [&](const int &x) { if (x > 1500) ++large; })
+            .dispatch(2, [](const int &x) { return x % 2; });
+    cases[0].seal(2, [&](int) { ++even; });
+    cases[1].seal(1, [&](int) { ++odd; });
+
+    input.loop();
+    // end of stream, flows stage by stage, no waiting for worker threads.
+    input.close();
+    input.completion().wait();
+
+    ohm::println("job ", id, ": even = ", even.load(), ", odd = ", odd.load(), ", large = ", large.load());
+}
+
+int main() {
+    // dedicated threads exit after pipe drained.
+    job(0, nullptr);
+
+    // jobs back to back on shared pool, no thread churn.
+    auto pool = std::make_shared<ohm::WorkStealingPool>(4);
+    for (int i = 1; i <= 3; ++i) {
+        job(i, pool);
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+//
+// Created by kier on 2020/12/8.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+int main() {
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 10000) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::atomic<int64_t> sum(0);
+    std::atomic<int> count(0);
+
+    // all stages share 4 threads, instead of 2 + 4 + 1 threads.
+    input.executor(std::make_shared<ohm::WorkStealingPool>(4)).limit(64)
+            .map(2, [](int x) { return x * 2; }).profile("double").limit(64)
+            .map(4, [](int x) -> int64_t { return int64_t(x) + 1; }).profile("increase").limit(64)
+            .seal(1, [&](int64_t x) {
+                sum += x;
+                ++count;
+            });
+
+    input.loop();
+    input.join();
+
+    // wait the last value sealed
+    while (count.load() < 10000) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ohm::println("count: ", count.load(), ", sum: ", sum.load(), ", expected: ", int64_t(10000) * 9999 + 10000);
+
+    auto report = input.report();
+    for (auto &name : report.lines) {
+        auto &line = report.report[name];
+        ohm::println(name, ": threads = ", line.threads, ", average = ", line.average_time);
+    }
+
+    return 0;
+}
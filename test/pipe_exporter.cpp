@@ -0,0 +1,77 @@
+//
+// Created by kier on 2020/12/20.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/pipe/pipe_exporter.h"
+#include "ohm/print.h"
+#include "ohm/filesys.h"
+
+#include <cstdlib>
+
+/**
+ * @return path in temporary directory, not leaving files in working directory
+ */
+std::string temp_path(const std::string &name) {
+    for (auto env : {"TMPDIR", "TEMP", "TMP"}) {
+        auto dir = std::getenv(env);
+        if (dir && *dir) return ohm::join_path({dir, name});
+    }
+    return ohm::join_path({"/tmp", name});
+}
+
+/**
+ * Scrape like Prometheus does.
+ */
+std::string scrape(int port) {
+    auto connection = ohm::Client::Connect(ohm::Protocol::TCP, ohm::IPv4("127.0.0.1", port));
+    std::string request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    connection.send(request.data(), int(request.size()));
+    std::string response;
+    char buffer[4096];
+    while (true) {
+        auto n = connection.recv(buffer, sizeof(buffer));
+        if (n <= 0) break;
+        response.append(buffer, size_t(n));
+    }
+    return response;
+}
+
+int main(int argc, const char *argv[]) {
+    // port could be given, if default port is taken by other process
+    int port = argc > 1 ? std::atoi(argv[1]) : 9464;
+
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 10000) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::atomic<int64_t> sum(0);
+    input.trace().limit(64).profile("decode")
+            .map(2, [](int x) {
+                std::this_thread::sleep_for(ohm::time::us(100));
+                return x * 2;
+            }).limit(64).profile("sum")
+            .seal(1, [&](int x) { sum += x; });
+
+    ohm::PipeExporter exporter(input.profiler());
+    exporter.label("pipeline", "demo");
+    auto path = temp_path("ohm_pipe_metrics.prom");
+    exporter.write(path, ohm::time::ms(100));
+    exporter.serve(port);
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+
+    auto response = scrape(port);
+    ohm::println("sum = ", sum.load());
+    ohm::println("scraped ", response.size(), " bytes:");
+    ohm::println(response.substr(0, response.find("# TYPE ohm_pipe_input_rate")));
+
+    // file is written once more in stopping, shows the finished graph
+    exporter.stop();
+    ohm::println("written to ", path);
+    return 0;
+}
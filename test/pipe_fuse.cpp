@@ -0,0 +1,49 @@
+//
+// Created by kier on 2020/12/16.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+int main() {
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 2000) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::atomic<int64_t> sum(0);
+    std::atomic<int> leaked(0);
+
+    // decode, scale, clip and sum run in the same 2 workers, no queue hop between them
+    auto decoded = input.fuse().trace().profile("decode").map(2, [](int x) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        return int64_t(x);
+    });
+    auto scaled = decoded.profile("scale").map(2, [&](int64_t x) -> int64_t {
+        if (x % 10 == 0) {
+            ++leaked;
+            throw ohm::PipeLeak();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        return x * 2;
+    });
+    auto clipped = scaled.profile("clip").map(2, [](int64_t x) { return x > 100000 ? int64_t(100000) : x; });
+    clipped.profile("sum").seal(2, [&](int64_t x) { sum += x; });
+
+    ohm::println("scale fused: ", decoded.fused(), ", clip fused: ", scaled.fused(), ", sum fused: ", clipped.fused());
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+
+    ohm::println("sum: ", sum.load(), ", leaked: ", leaked.load());
+    // time of each fused function is still reported in its own line, excluding functions fused after it
+    auto report = input.report();
+    for (auto &name : report.lines) {
+        auto &line = report.report[name];
+        ohm::println(name, ": ", line.trace.service.count, " values, service p50 = ", line.trace.service.p50, "us");
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+//
+// Created by kier on 2020/12/17.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+struct Packet {
+    int id;
+    std::vector<int> payload;
+};
+
+int main() {
+    int next = 0;
+    // end of data told by empty value, no PipeBreak
+    ohm::Tap<int> input([&]() -> ohm::PipeMaybe<int> {
+        if (next >= 100000) return {};
+        return next++;
+    });
+
+    std::atomic<int64_t> count(0), sum(0);
+
+    // drop 90% data without throwing PipeLeak
+    input.map(2, [](int x) -> ohm::PipeMaybe<Packet> {
+                if (x % 10 != 0) return {};
+                return Packet{x, std::vector<int>(size_t(x % 7), x)};
+            })
+            // expand payload by allocation-free generator, ended by empty value
+            .map(2, [](Packet packet) {
+                return ohm::make_range_generator(std::move(packet.payload));
+            })
+            .map_ordered(2, [](int x) -> ohm::PipeMaybe<int> {
+                if (x % 3 == 0) return {};
+                return x;
+            })
+            .seal(1, [&](int x) {
+                ++count;
+                sum += x;
+            });
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+
+    int64_t expect_count = 0, expect_sum = 0;
+    for (int x = 0; x < 100000; x += 10) {
+        if (x % 3 == 0) continue;
+        expect_count += x % 7;
+        expect_sum += int64_t(x) * (x % 7);
+    }
+    ohm::println("count: ", count.load(), " (expect ", expect_count, "), sum: ", sum.load(),
+                 " (expect ", expect_sum, ")");
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+//
+// Created by kier on 2020/12/13.
+//
+
+#include "ohm/pipe/pipe_merge.h"
+#include "ohm/print.h"
+
+struct Shot {
+    int camera;
+    int frame;
+    int64_t stamp;
+};
+
+int main() {
+    // all pipes in one graph, so completion covers all of them
+    auto profiler = std::make_shared<ohm::PipeProfiler>();
+    std::vector<ohm::Pipe<Shot>> cameras;
+    for (int i = 0; i < 6; ++i) cameras.emplace_back(profiler);
+
+    // any order
+    std::atomic<int> merged_count(0);
+    ohm::merge<Shot>({cameras[0], cameras[1]}).seal([&](Shot) { ++merged_count; });
+
+    // join with frame id, frame 5 of camera 3 is lost, so it is evicted.
+    // capacity should cover the delay between pipes, or keys are evicted before joined.
+    auto zipped = ohm::zip_by_key<Shot>({cameras[2], cameras[3].map(2, [](Shot shot) { return shot; })},
+                                        [](const Shot &shot) { return shot.frame; }, 128);
+    std::atomic<int> zipped_count(0);
+    zipped.profile("zip").seal([&](std::vector<Shot> shots) {
+        if (shots[0].frame == shots[1].frame) ++zipped_count;
+    });
+
+    // time ordered
+    int64_t last = 0;
+    int disorder = 0;
+    auto ordered = ohm::merge_by_time<Shot>({cameras[4], cameras[5].map(1, [](Shot shot) { return shot; })},
+                                            [](const Shot &shot) { return shot.stamp; }, 256);
+    ordered.profile("sync").seal([&](Shot shot) {
+        if (shot.stamp < last) ++disorder;
+        last = shot.stamp;
+    });
+
+    for (int i = 0; i < 100; ++i) {
+        for (int c = 0; c < 6; ++c) {
+            if (c == 3 && i == 5) continue;
+            cameras[c].push({c, i, i * 30 + c});
+        }
+    }
+    for (auto &camera : cameras) camera.close();
+    cameras[0].completion().wait();
+
+    auto report = cameras[0].report();
+    ohm::println("merged: ", merged_count.load(), ", zipped: ", zipped_count.load(),
+                 ", evicted: ", report.report["zip"].metrics["zip.evicted"],
+                 ", disorder: ", disorder, ", late: ", report.report["sync"].metrics["merge.late"]);
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+//
+// Created by kier on 2020/12/4.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+struct Frame {
+    int id;
+    std::vector<uint8_t> pixels;
+
+    explicit Frame(int id) : id(id), pixels(1920 * 1080 * 3) {}
+
+    Frame(const Frame &) = delete;
+
+    Frame &operator=(const Frame &) = delete;
+};
+
+using FramePtr = std::unique_ptr<Frame>;
+
+int main() {
+    int next = 0;
+    // move-only data can be generated, mapped, dispatched and sealed without copy.
+    ohm::Tap<FramePtr> input([&]() -> FramePtr {
+        if (next >= 20) throw ohm::PipeBreak();
+        return FramePtr(new Frame(next++));
+    });
+
+    std::atomic<int> even(0), odd(0);
+
+    auto cases = input.limit(4).storage(ohm::DISPATCH_STORAGE_MPMC)
+            .map(2, [](FramePtr frame) -> FramePtr {
+                frame->pixels[0] = uint8_t(frame->id);
+                return frame;
+            }).limit(4)
+            .map(1, [](FramePtr &frame) {
+                frame->pixels[1] = 1;
+            })
+            .map(2, [](FramePtr frame) -> std::vector<FramePtr> {
+                std::vector<FramePtr> tiles;
+                tiles.push_back(std::move(frame));
+                return tiles;
+            })
+            .dispatch(2, [](const FramePtr &frame) { return frame->id % 2; });
+
+    cases[0].seal(1, [&](FramePtr frame) { ++even; });
+    cases[1].seal(1, [&](FramePtr frame) { ++odd; });
+
+    input.loop();
+    input.join();
+
+    // wait the last frame sealed
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ohm::println("even: ", even.load(), ", odd: ", odd.load());
+
+    return 0;
+}
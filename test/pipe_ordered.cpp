@@ -0,0 +1,57 @@
+//
+// Created by kier on 2020/12/9.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+#include "ohm/random.h"
+
+static int random_ms() {
+    static thread_local ohm::Random random(int(std::hash<std::thread::id>()(std::this_thread::get_id())));
+    return random.next(0, 5);
+}
+
+int main() {
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 200) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::atomic<int> count(0);
+    std::atomic<int> disorder(0);
+    int expected = 0;
+
+    // workers finish in random order, but the child pipe gets frames in input order.
+    input.limit(8).profile("decode")
+            .map_ordered(4, [](int frame) -> int {
+                std::this_thread::sleep_for(std::chrono::milliseconds(random_ms()));
+                return frame;
+            }, 8)
+            .map_ordered(3, [](int frame) -> std::vector<int> {
+                std::this_thread::sleep_for(std::chrono::milliseconds(random_ms()));
+                return {frame * 2, frame * 2 + 1};
+            })
+            .seal([&](int tile) {
+                if (tile != expected) ++disorder;
+                expected = tile + 1;
+                ++count;
+            });
+
+    auto report_loop = std::thread([&]() {
+        while (count.load() < 400) {
+            auto report = input.report();
+            auto &line = report.report["decode"];
+            ohm::println("decode: reorder = ", line.metrics["reorder"]);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    });
+
+    input.loop();
+    input.join();
+    report_loop.join();
+
+    ohm::println("count: ", count.load(), ", disorder: ", disorder.load());
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+//
+// Created by kier on 2020/12/14.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+struct Packet {
+    enum Kind {
+        CONTROL = 0,
+        KEYFRAME = 1,
+        FRAME = 2,
+    };
+
+    Kind kind;
+    int id;
+    std::chrono::steady_clock::time_point stamp;
+};
+
+int main() {
+    ohm::Pipe<Packet> input;
+
+    std::mutex mutex;
+    std::map<int, double> max_wait;
+    std::map<int, int> count;
+
+    // decoder is slower than input, routine frames pile up in the last lane.
+    input.lanes(3, [](const Packet &packet) { return size_t(packet.kind); }, ohm::time::ms(50))
+            .lane(Packet::FRAME, 32, ohm::DISPATCH_KEEP_NEW)
+            .profile("decode")
+            .seal(1, [&](Packet packet) {
+                auto wait = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - packet.stamp).count();
+                std::this_thread::sleep_for(std::chrono::microseconds(600));
+                std::unique_lock<std::mutex> _lock(mutex);
+                max_wait[packet.kind] = std::max(max_wait[packet.kind], wait);
+                ++count[packet.kind];
+            });
+
+    for (int i = 0; i < 1000; ++i) {
+        auto kind = i % 100 == 0 ? Packet::CONTROL : i % 25 == 0 ? Packet::KEYFRAME : Packet::FRAME;
+        input.push({kind, i, std::chrono::steady_clock::now()});
+        std::this_thread::sleep_for(std::chrono::microseconds(300));
+        if (i % 200 == 0) {
+            auto report = input.report();
+            auto &metrics = report.report["decode"].metrics;
+            ohm::println("depth: ", metrics["lane0.depth"], ", ", metrics["lane1.depth"], ", ",
+                         metrics["lane2.depth"], ", frame wait: ", metrics["lane2.wait_us"], "us");
+        }
+    }
+    input.close();
+    input.completion().wait();
+
+    auto report = input.report();
+    auto &metrics = report.report["decode"].metrics;
+    ohm::println("control: ", count[Packet::CONTROL], ", max wait ", max_wait[Packet::CONTROL], "ms");
+    ohm::println("keyframe: ", count[Packet::KEYFRAME], ", max wait ", max_wait[Packet::KEYFRAME], "ms");
+    ohm::println("frame: ", count[Packet::FRAME], ", max wait ", max_wait[Packet::FRAME], "ms",
+                 ", dropped ", metrics["lane2.dropped"]);
+
+    return 0;
+}
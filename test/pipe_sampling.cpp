@@ -0,0 +1,55 @@
+//
+// Created by kier on 2020/12/19.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+void print_line(ohm::PipeProfiler::Report &report, const std::string &name) {
+    auto &line = report.report[name];
+    ohm::println("    ", name, ": out ", line.queue.out.dps, " dps, timed ", line.time.count,
+                 " values, traced ", line.trace.latency.count, " values, latency p99 = ",
+                 line.trace.latency.p99, "us");
+}
+
+int main() {
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 1000000) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::atomic<int64_t> sum(0);
+    // counts are exact, one in 100 values timed and traced in parse, about 200 each second in sum
+    input.trace().limit(256)
+            .map(1, [](int x) { return x * 2; }).limit(256)
+            .profile("parse", ohm::DispatcherSampling::OneIn(100))
+            .map(1, [](int x) { return x + 1; }).limit(256)
+            .profile("sum", ohm::DispatcherSampling::PerSecond(200))
+            .seal(1, [&](int x) { sum += x; });
+
+    std::thread monitor([&]() {
+        auto done = input.completion();
+        int ticks = 0;
+        while (done.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+            // sample every value of parse after a while, without rebuilding graph
+            if (++ticks == 3) input.profiler()->sampling("parse", ohm::DispatcherSampling::Every());
+            auto report = input.report();
+            ohm::println("tick ", ticks);
+            print_line(report, "parse");
+            print_line(report, "sum");
+        }
+    });
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+    monitor.join();
+
+    auto report = input.report();
+    ohm::println("sum = ", sum.load());
+    print_line(report, "parse");
+    print_line(report, "sum");
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+//
+// Created by kier on 2020/12/20.
+//
+
+// define before including to read time stamp counter on x86
+// #define OHM_CLOCK_TSC true
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/time_summary.h"
+#include "ohm/print.h"
+
+/**
+ * Busy working for `us` microseconds, like short stages which would be reported as 0ms.
+ */
+void work(int64_t us) {
+    auto until = ohm::steady_now() + ohm::time::us(us);
+    while (ohm::steady_now() < until) {}
+}
+
+int main() {
+    ohm::TimeSummary summary("pipe timing");
+    ohm::println("time stamp counter: ", ohm::MonotonicClock::tsc() ? "on" : "off");
+
+    // cost of reading clock
+    static const int READS = 1000000;
+    auto begin = ohm::steady_now();
+    for (int i = 0; i < READS; ++i) ohm::steady_now();
+    auto spent = ohm::steady_now() - begin;
+    ohm::println("read clock: ", spent / READS);
+    summary.done("read clock");
+
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 2000) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::atomic<int64_t> sum(0);
+    input.limit(16).profile("300us")
+            .map(1, [](int x) { work(300); return x; }).limit(16).profile("50us")
+            .map(1, [](int x) { work(50); return x; }).limit(16).profile("sum")
+            .seal(1, [&](int x) { sum += x; });
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+    summary.done("pipe");
+
+    auto report = input.report();
+    ohm::println("sum = ", sum.load());
+    for (auto &name : {"300us", "50us", "sum"}) {
+        auto &line = report.report[name];
+        ohm::println(name, ": average ", line.average_time, ", p50 ", line.time.p50,
+                     "us, p99 ", line.time.p99, "us, max ", line.time.max, "us");
+    }
+
+    summary.summary(std::cout);
+
+    return 0;
+}
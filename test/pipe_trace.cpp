@@ -0,0 +1,47 @@
+//
+// Created by kier on 2020/12/15.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+void print_summary(const std::string &name, const ohm::PipeHistogram::Summary &summary) {
+    ohm::println("    ", name, ": p50 = ", summary.p50, "us, p90 = ", summary.p90,
+                 "us, p99 = ", summary.p99, "us, max = ", summary.max, "us");
+}
+
+int main() {
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 500) throw ohm::PipeBreak();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return next++;
+    });
+
+    // stamp values at input, every profiled pipe after reports percentiles
+    input.trace().profile("decode")
+            .map(2, [](int x) {
+                std::this_thread::sleep_for(std::chrono::microseconds(1500));
+                return x;
+            }).profile("detect")
+            .map(1, [](int x) {
+                std::this_thread::sleep_for(std::chrono::microseconds(x % 10 == 0 ? 3000 : 500));
+                return x;
+            }).profile("show")
+            .seal(1, [](int) {});
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+
+    auto report = input.report();
+    for (auto &name : report.lines) {
+        auto &line = report.report[name];
+        ohm::println(name, ": ", line.trace.latency.count, " values");
+        print_summary("queue wait", line.trace.wait);
+        print_summary("service", line.trace.service);
+        print_summary("latency", line.trace.latency);
+    }
+
+    return 0;
+}
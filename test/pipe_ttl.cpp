@@ -0,0 +1,55 @@
+//
+// Created by kier on 2020/12/15.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+using clock_type = std::chrono::steady_clock;
+
+struct Frame {
+    int id;
+    clock_type::time_point captured;
+    clock_type::time_point deadline;    ///< result is useless after deadline
+};
+
+int main() {
+    int next = 0;
+    ohm::Tap<Frame> camera([&]() -> Frame {
+        if (next >= 300) throw ohm::PipeBreak();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        auto now = clock_type::now();
+        return {next++, now, now + std::chrono::milliseconds(60)};
+    });
+
+    std::atomic<int> detected(0), tracked(0);
+    std::atomic<int64_t> oldest(0);
+
+    // detector is slower than camera, frames waited more than 20ms are skipped instead of processed.
+    camera.ttl(ohm::time::ms(20)).profile("detect")
+            .map(2, [&](Frame frame) {
+                auto age = std::chrono::duration_cast<ohm::time::ms>(clock_type::now() - frame.captured).count();
+                if (age > oldest) oldest = age;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                ++detected;
+                return frame;
+            })
+            .storage(ohm::DISPATCH_STORAGE_MPMC, 64)
+            .deadline([](const Frame &frame) { return frame.deadline; })
+            .profile("track")
+            .seal(1, [&](Frame frame) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(8));
+                ++tracked;
+            });
+
+    camera.loop();
+    camera.close();
+    camera.completion().wait();
+
+    auto report = camera.report();
+    ohm::println("detected: ", detected.load(), ", expired: ", report.report["detect"].metrics["expired"],
+                 ", oldest frame detected: ", oldest.load(), "ms");
+    ohm::println("tracked: ", tracked.load(), ", expired: ", report.report["track"].metrics["expired"]);
+
+    return 0;
+}
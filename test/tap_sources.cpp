@@ -0,0 +1,71 @@
+//
+// Created by kier on 2020/12/16.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/print.h"
+
+struct Frame {
+    int camera;
+    int id;
+    ohm::time::us stamp;    ///< recorded time
+};
+
+int main() {
+    using clock_type = std::chrono::steady_clock;
+
+    // 4 cameras generate concurrently into one pipe, each tagged by source index, 100 fps each
+    {
+        std::vector<int> next(4, 0);
+        ohm::Tap<Frame> cameras(4, [&](int camera) -> Frame {
+            auto id = next[camera]++;
+            if (id >= 50) throw ohm::PipeBreak();
+            return {camera, id, ohm::time::us(0)};
+        });
+        cameras.pace(100);
+
+        std::vector<std::atomic<int>> counts(4);
+        for (auto &count : counts) count = 0;
+        cameras.seal(1, [&](Frame frame) { ++counts[frame.camera]; });
+
+        auto start = clock_type::now();
+        cameras.loop();
+        cameras.close();
+        cameras.completion().wait();
+        auto spent = std::chrono::duration_cast<ohm::time::ms>(clock_type::now() - start).count();
+
+        ohm::println("cameras: ", counts[0].load(), ", ", counts[1].load(), ", ",
+                     counts[2].load(), ", ", counts[3].load(), " frames in ", spent, "ms, expect 490ms");
+    }
+
+    // replay recorded frames at twice recorded speed, frames recorded with irregular gaps
+    {
+        std::vector<Frame> recorded;
+        int64_t stamp = 1000000;
+        for (int i = 0; i < 100; ++i) {
+            recorded.push_back({0, i, ohm::time::us(stamp)});
+            stamp += i % 10 == 0 ? 30000 : 5000;
+        }
+        ohm::Tap<Frame> replay(recorded);
+        replay.pace([](const Frame &frame) { return frame.stamp; }, 2);
+
+        std::atomic<int64_t> late(0);
+        auto start = clock_type::now();
+        replay.seal(1, [&](Frame frame) {
+            auto expect = (frame.stamp - recorded.front().stamp) / 2;
+            auto actual = std::chrono::duration_cast<ohm::time::us>(clock_type::now() - start);
+            auto diff = (actual - expect).count();
+            if (diff > late) late = diff;
+        });
+
+        replay.loop();
+        replay.close();
+        replay.completion().wait();
+        auto spent = std::chrono::duration_cast<ohm::time::ms>(clock_type::now() - start).count();
+
+        ohm::println("replay: ", spent, "ms, expect ", (stamp - 5000 - recorded.front().stamp.count()) / 2000,
+                     "ms, max late ", late.load(), "us");
+    }
+
+    return 0;
+}
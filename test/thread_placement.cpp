@@ -0,0 +1,68 @@
+//
+// Created by kier on 2020/12/16.
+//
+
+#include "ohm/pipe/pipe.h"
+#include "ohm/thread/shotgun.h"
+#include "ohm/print.h"
+
+#if OHM_PLATFORM_OS_LINUX
+#include <sched.h>
+#endif
+
+int current_cpu() {
+#if OHM_PLATFORM_OS_LINUX
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+int main() {
+    auto cpus = int(std::thread::hardware_concurrency());
+    if (cpus <= 0) cpus = 1;
+
+    std::vector<int> all, first, second;
+    for (int i = 0; i < cpus; ++i) {
+        all.push_back(i);
+        (i % 2 == 0 ? first : second).push_back(i);
+    }
+    if (second.empty()) second = first;
+
+    // each worker of shotgun stays on its own CPU
+    {
+        ohm::Shotgun gun(size_t(cpus), ohm::ThreadPlacement().cpus(all).spread());
+        std::mutex mutex;
+        for (int i = 0; i < cpus; ++i) {
+            gun.fire([&, i]() {
+                std::unique_lock<std::mutex> _lock(mutex);
+                ohm::println("shotgun job ", i, " on cpu ", current_cpu());
+            });
+        }
+        gun.join();
+    }
+
+    // stages of pipe placed on different CPUs, prefer NUMA node 0, real-time priority if permitted
+    auto skipped = ohm::ThreadPlacement().numa(0).fifo(10).apply();
+    ohm::println("skipped settings in main thread: ", skipped);
+
+    int next = 0;
+    ohm::Tap<int> input([&]() -> int {
+        if (next >= 100) throw ohm::PipeBreak();
+        return next++;
+    });
+
+    std::atomic<int> sum(0);
+    input.placement(ohm::ThreadPlacement().cpus(first).numa(0).nice(5))
+            .map(2, [](int x) { return x * 2; })
+            .placement(ohm::ThreadPlacement().cpus(second).spread().fifo(10))
+            .seal(2, [&](int x) { sum += x; });
+
+    input.loop();
+    input.close();
+    input.completion().wait();
+
+    ohm::println("sum: ", sum.load());
+
+    return 0;
+}